@@ -0,0 +1,177 @@
+// Times the BigInteger and Rational operations of bigint.h over operand sizes
+// from one limb to a million decimal digits. Results go to the console and,
+// with --json, to a file in Google Benchmark's JSON layout that
+// bench/bigint_compare.py checks against a stored baseline.
+//
+//   g++ -std=c++17 -O2 bench/bigint_bench.cpp -o bigint_bench
+//   ./bigint_bench --json=baseline.json
+//   ./bigint_bench --json=current.json [--filter=mul] [--max-digits=100000]
+//   python3 bench/bigint_compare.py baseline.json current.json
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <sstream>
+
+#include "../bigint.h"
+
+struct BigIntegerBenchmark {
+  struct Result {
+    std::string name;
+    size_t iterations;
+    double nanoseconds;
+  };
+
+  std::string filter;
+  size_t maxDigits = 1000000;
+  double minTime = 0.2;
+  std::vector<Result> results;
+
+  // Keeps the compiler from dropping a result that is otherwise unused.
+  template <typename T>
+  static void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  // A positive value of the given number of decimal digits, or one digit
+  // fewer, from a seeded generator so that runs see the same operands.
+  static BigInteger randomValue(size_t digits, unsigned seed) {
+    std::mt19937 gen(seed);
+    size_t bytes = std::max<size_t>(1, digits * 3322 / 8000);
+    std::vector<uint8_t> data(bytes);
+    for (uint8_t& b : data) b = static_cast<uint8_t>(gen());
+    data.back() = static_cast<uint8_t>(data.back() % 0x7f + 1);
+    return BigInteger::importBytes(data.data(), data.size());
+  }
+
+  // Runs body in batches that double until one lasts minTime.
+  template <typename Body>
+  void measure(const std::string& name, Body body) {
+    if (!filter.empty() and name.find(filter) == std::string::npos) return;
+
+    body();
+    size_t reps = 1;
+    while (true) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < reps; ++i) body();
+      std::chrono::duration<double> spent =
+          std::chrono::steady_clock::now() - start;
+      if (spent.count() >= minTime or reps >= (size_t(1) << 30)) {
+        results.push_back({name, reps, spent.count() * 1e9 / reps});
+        std::printf("%-28s %14.0f ns %12zu\n", name.c_str(),
+                    results.back().nanoseconds, reps);
+        std::fflush(stdout);
+        return;
+      }
+      reps *= 2;
+    }
+  }
+
+  void integerBenchmarks(size_t digits) {
+    std::string size = "/" + std::to_string(digits);
+    BigInteger a = randomValue(digits, 1), b = randomValue(digits, 2);
+    BigInteger wide = randomValue(2 * digits, 3);
+    BigInteger res;
+
+    measure("add" + size, [&] { res = a + b; });
+    measure("sub" + size, [&] { res = a - b; });
+    measure("mul" + size, [&] { res = a * b; });
+    measure("sqr" + size, [&] { res = a.square(); });
+    measure("div" + size, [&] { res = wide / a; });
+    measure("mod" + size, [&] { res = wide % a; });
+    measure("toString" + size, [&] { keep(a.toString().size()); });
+
+    std::string text = a.toString();
+    measure("parse" + size, [&] {
+      std::istringstream in(text);
+      in >> res;
+    });
+    if (digits <= 100000) measure("gcd" + size, [&] { res = gcd(a, b); });
+  }
+
+  void rationalBenchmarks(size_t digits) {
+    std::string size = "/" + std::to_string(digits);
+    Rational x = Rational(randomValue(digits, 4)) /
+                 Rational(randomValue(digits, 5));
+    Rational y = Rational(randomValue(digits, 6)) /
+                 Rational(randomValue(digits, 7));
+    Rational res;
+
+    measure("rational_add" + size, [&] { res = x + y; });
+    measure("rational_mul" + size, [&] { res = x * y; });
+    measure("rational_div" + size, [&] { res = x / y; });
+    measure("rational_cmp" + size, [&] { keep(x < y); });
+    measure("asDecimal" + size, [&] { keep(x.asDecimal(digits).size()); });
+  }
+
+  void run() {
+    // 9 digits fill one limb; 10^6 digits take about 104k limbs.
+    for (size_t digits : {9, 100, 1000, 10000, 100000, 1000000}) {
+      if (digits > maxDigits) break;
+      integerBenchmarks(digits);
+      if (digits <= 10000) rationalBenchmarks(digits);
+    }
+  }
+
+  void writeJson(const char* path) const {
+    FILE* out = std::fopen(path, "w");
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", path);
+      return;
+    }
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S",
+                  std::localtime(&now));
+
+    std::fprintf(out, "{\n  \"context\": {\n");
+    std::fprintf(out, "    \"date\": \"%s\",\n", date);
+    std::fprintf(out, "    \"library\": \"bigint.h\",\n");
+    std::fprintf(out, "    \"threads\": %zu,\n", BigInteger::threadCount());
+    std::fprintf(out, "    \"karatsuba_threshold\": %d,\n",
+                 BIGINT_KARATSUBA_THRESHOLD);
+    std::fprintf(out, "    \"toom3_threshold\": %d,\n", BIGINT_TOOM3_THRESHOLD);
+    std::fprintf(out, "    \"ntt_threshold\": %d,\n", BIGINT_NTT_THRESHOLD);
+    std::fprintf(out, "    \"min_time\": %g\n  },\n", minTime);
+    std::fprintf(out, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result& r = results[i];
+      std::fprintf(out,
+                   "    {\"name\": \"%s\", \"iterations\": %zu, "
+                   "\"real_time\": %.1f, \"cpu_time\": %.1f, "
+                   "\"time_unit\": \"ns\"}%s\n",
+                   r.name.c_str(), r.iterations, r.nanoseconds, r.nanoseconds,
+                   i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    std::fclose(out);
+  }
+};
+
+int main(int argc, char** argv) {
+  BigIntegerBenchmark bench;
+  const char* json = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strncmp(argv[i], "--json=", 7)) {
+      json = argv[i] + 7;
+    } else if (!std::strncmp(argv[i], "--filter=", 9)) {
+      bench.filter = argv[i] + 9;
+    } else if (!std::strncmp(argv[i], "--max-digits=", 13)) {
+      bench.maxDigits = std::strtoull(argv[i] + 13, nullptr, 10);
+    } else if (!std::strncmp(argv[i], "--min-time=", 11)) {
+      bench.minTime = std::strtod(argv[i] + 11, nullptr);
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--json=FILE] [--filter=SUBSTRING] "
+                   "[--max-digits=N] [--min-time=SECONDS]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+
+  std::printf("%-28s %17s %12s\n", "benchmark", "time", "iterations");
+  bench.run();
+  if (json) bench.writeJson(json);
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Compares two benchmark JSON files from bigint_bench (or Google Benchmark).
+
+    python3 bench/bigint_compare.py baseline.json current.json [--threshold 0.1]
+
+Prints the time ratio current / baseline of every benchmark present in both
+files and exits with status 1 if any of them got slower by more than the
+threshold (10% by default).
+"""
+
+import argparse
+import json
+import sys
+
+UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    times = {}
+    for entry in data.get("benchmarks", []):
+        if entry.get("run_type", "iteration") != "iteration":
+            continue
+        scale = UNITS[entry.get("time_unit", "ns")]
+        times[entry["name"]] = entry["real_time"] * scale
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.1,
+                        help="relative slowdown reported as a regression")
+    args = parser.parse_args()
+
+    baseline, current = load(args.baseline), load(args.current)
+    regressions = 0
+    print(f"{'benchmark':28} {'baseline':>14} {'current':>14} {'ratio':>7}")
+    for name, before in baseline.items():
+        if name not in current:
+            continue
+        after = current[name]
+        ratio = after / before if before else float("inf")
+        flag = ""
+        if ratio > 1 + args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif ratio < 1 - args.threshold:
+            flag = "  faster"
+        print(f"{name:28} {before:12.0f}ns {after:12.0f}ns {ratio:7.3f}{flag}")
+
+    missing = [name for name in baseline if name not in current]
+    if missing:
+        print(f"\nnot in {args.current}: {', '.join(missing)}")
+    print(f"\n{regressions} regression(s) above {args.threshold:.0%}")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,148 @@
+// Measures the multiplication and division crossovers of bigint.h on the host CPU and
+// prints the -D flags that select them.
+//
+//   g++ -std=c++17 -O2 bench/bigint_tune.cpp -o bigint_tune && ./bigint_tune
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "../bigint.h"
+
+struct BigIntegerTuning {
+  typedef void (*Kernel)(const limb*, size_t, const limb*, size_t, limb*);
+  typedef void (*SqrKernel)(const limb*, size_t, limb*);
+  typedef void (*DivKernel)(const BigInteger&, const BigInteger&, BigInteger&,
+                            BigInteger&);
+
+  static double timeKernel(Kernel kernel, size_t size) {
+    std::mt19937 gen(size);
+    std::vector<limb> a(size), b(size), res(2 * size);
+    for (size_t i = 0; i < size; ++i) {
+      a[i] = gen();
+      b[i] = gen();
+    }
+
+    // Repeat until the measurement is long enough to be stable.
+    size_t reps = 1;
+    while (true) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < reps; ++i)
+        kernel(a.data(), size, b.data(), size, res.data());
+      std::chrono::duration<double> spent =
+          std::chrono::steady_clock::now() - start;
+      if (spent.count() > 0.02) return spent.count() / reps;
+      reps *= 2;
+    }
+  }
+
+  static double timeKernel(SqrKernel kernel, size_t size) {
+    std::mt19937 gen(size);
+    std::vector<limb> a(size), res(2 * size);
+    for (limb& x : a) x = gen();
+
+    size_t reps = 1;
+    while (true) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < reps; ++i) kernel(a.data(), size, res.data());
+      std::chrono::duration<double> spent =
+          std::chrono::steady_clock::now() - start;
+      if (spent.count() > 0.02) return spent.count() / reps;
+      reps *= 2;
+    }
+  }
+
+  static void sqrKaratsuba(const limb* a, size_t n, limb* res) {
+    BigInteger::mulKaratsuba(a, n, a, n, res);
+  }
+
+  // Burnikel-Ziegler and Newton division recurse down to a cutoff length.
+  // The faster kernel of a crossover gets the divisor length as its cutoff,
+  // so it runs one level of its own algorithm at every measured size,
+  // whatever thresholds this file was compiled with.
+  static inline size_t bzCutoff = BIGINT_BZ_THRESHOLD;
+
+  static void divBzOneLevel(const BigInteger& a, const BigInteger& b,
+                            BigInteger& q, BigInteger& r) {
+    BigInteger::divBurnikelZiegler(a, b, q, r, b.digits.size());
+  }
+
+  static void divBzTuned(const BigInteger& a, const BigInteger& b,
+                         BigInteger& q, BigInteger& r) {
+    BigInteger::divBurnikelZiegler(a, b, q, r, bzCutoff);
+  }
+
+  static void divNewtonOneLevel(const BigInteger& a, const BigInteger& b,
+                                BigInteger& q, BigInteger& r) {
+    BigInteger::divNewton(a, b, q, r, b.digits.size());
+  }
+
+  // Times the division of a 2 * size limb dividend by a size limb divisor.
+  static double timeKernel(DivKernel kernel, size_t size) {
+    std::mt19937 gen(size);
+    std::vector<limb> a(2 * size), b(size);
+    for (limb& x : a) x = gen();
+    for (limb& x : b) x = gen();
+    b.back() |= 1;
+    BigInteger dividend = BigInteger::fromLimbs(a.data(), a.size());
+    BigInteger divisor = BigInteger::fromLimbs(b.data(), b.size());
+    BigInteger q, r;
+
+    size_t reps = 1;
+    while (true) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < reps; ++i) kernel(dividend, divisor, q, r);
+      std::chrono::duration<double> spent =
+          std::chrono::steady_clock::now() - start;
+      if (spent.count() > 0.02) return spent.count() / reps;
+      reps *= 2;
+    }
+  }
+
+  // Returns the smallest size from which the faster kernel wins three
+  // consecutive measurements.
+  template <typename K>
+  static size_t crossover(const char* name, K slow, K fast, size_t from,
+                          size_t to, size_t step) {
+    size_t wins = 0, candidate = to;
+    for (size_t size = from; size <= to; size += step) {
+      double slowTime = timeKernel(slow, size);
+      double fastTime = timeKernel(fast, size);
+      std::printf("%-24s %6zu limbs: %10.3f us vs %10.3f us\n", name, size,
+                  slowTime * 1e6, fastTime * 1e6);
+      if (fastTime < slowTime) {
+        if (wins++ == 0) candidate = size;
+        if (wins == 3) return candidate;
+      } else {
+        wins = 0;
+      }
+    }
+    return to;
+  }
+
+  static void run() {
+    size_t karatsuba =
+        crossover("schoolbook/karatsuba", BigInteger::mulSchoolbook,
+                  BigInteger::mulKaratsuba, 8, 200, 4);
+    size_t karatsubaSqr =
+        crossover("sqr schoolbook/karatsuba", BigInteger::sqrSchoolbook,
+                  sqrKaratsuba, 8, 300, 4);
+    size_t toom3 = crossover("karatsuba/toom3", BigInteger::mulKaratsuba,
+                             BigInteger::mulToom3, 40, 800, 20);
+    size_t ntt = crossover("toom3/ntt", BigInteger::mulToom3,
+                           BigInteger::nttMultiply, 200, 8000, 200);
+    size_t bz = crossover("schoolbook/bz", BigInteger::divSchoolbook,
+                          divBzOneLevel, 10, 400, 10);
+    bzCutoff = bz;
+    size_t newton = crossover("bz/newton", divBzTuned, divNewtonOneLevel,
+                              5000, 100000, 5000);
+
+    std::printf("\n-DBIGINT_KARATSUBA_THRESHOLD=%zu"
+                " -DBIGINT_KARATSUBA_SQR_THRESHOLD=%zu"
+                " -DBIGINT_TOOM3_THRESHOLD=%zu -DBIGINT_NTT_THRESHOLD=%zu"
+                " -DBIGINT_BZ_THRESHOLD=%zu -DBIGINT_NEWTON_THRESHOLD=%zu\n",
+                karatsuba, karatsubaSqr, toom3, ntt, bz, newton);
+  }
+};
+
+int main() { BigIntegerTuning::run(); }
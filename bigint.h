@@ -1,41 +1,833 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
-#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-typedef std::complex<double> comp;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#if __cplusplus >= 202002L
+#include <compare>
+#endif
+
+typedef uint32_t limb;
+typedef uint64_t dlimb;
+
+enum class ByteOrder { littleEndian, bigEndian };
+
+// Multiplication crossovers, in limbs of the shorter operand. Override them
+// with -D to match the host; bench/bigint_tune.cpp measures suitable values.
+#ifndef BIGINT_KARATSUBA_THRESHOLD
+#define BIGINT_KARATSUBA_THRESHOLD 40
+#endif
+
+// Squares use a schoolbook loop with half the limb products, so Karatsuba
+// takes over later than for general products.
+#ifndef BIGINT_KARATSUBA_SQR_THRESHOLD
+#define BIGINT_KARATSUBA_SQR_THRESHOLD 60
+#endif
+
+#ifndef BIGINT_TOOM3_THRESHOLD
+#define BIGINT_TOOM3_THRESHOLD 300
+#endif
+
+#ifndef BIGINT_NTT_THRESHOLD
+#define BIGINT_NTT_THRESHOLD 2500
+#endif
+
+// Division crossovers, in limbs of the divisor.
+#ifndef BIGINT_BZ_THRESHOLD
+#define BIGINT_BZ_THRESHOLD 160
+#endif
+
+#ifndef BIGINT_NEWTON_THRESHOLD
+#define BIGINT_NEWTON_THRESHOLD 50000
+#endif
+
+// Decimal conversion splits numbers longer than this many limbs by powers of
+// 10^9 instead of converting them 9 digits at a time.
+#ifndef BIGINT_RADIX_THRESHOLD
+#define BIGINT_RADIX_THRESHOLD 40
+#endif
+
+// gcd switches from Lehmer steps to half-gcd reduction for operands longer
+// than this many limbs. Once inside, half-gcd keeps recursing on leading
+// parts down to the much shorter BIGINT_HGCD_BASE_THRESHOLD.
+#ifndef BIGINT_HGCD_THRESHOLD
+#define BIGINT_HGCD_THRESHOLD 10000
+#endif
+
+#ifndef BIGINT_HGCD_BASE_THRESHOLD
+#define BIGINT_HGCD_BASE_THRESHOLD 400
+#endif
+
+// With BIGINT_RATIONAL_LAZY set, Rational arithmetic skips gcd reduction and
+// reduces a value only when it is printed or compared for equality.
+#ifndef BIGINT_RATIONAL_LAZY
+#define BIGINT_RATIONAL_LAZY 0
+#endif
+
+// NTT products whose shorter operand has at least this many limbs split the
+// transforms across BIGINT_THREADS threads (see BigInteger::setThreadCount).
+#ifndef BIGINT_PARALLEL_THRESHOLD
+#define BIGINT_PARALLEL_THRESHOLD 20000
+#endif
+
+#ifndef BIGINT_THREADS
+#define BIGINT_THREADS 1
+#endif
+
+// NTT butterflies use AVX-512 or AVX2 when the CPU has them; 0 keeps the
+// scalar loop.
+#ifndef BIGINT_SIMD
+#define BIGINT_SIMD 1
+#endif
+
+// With BIGINT_STATS set, the main routines count their calls and operand
+// limbs, and the limb buffers of values, of multiplication scratch and of the
+// NTT root tables are recorded as they are allocated; see BigIntegerStats.
+#ifndef BIGINT_STATS
+#define BIGINT_STATS 0
+#endif
+
+static_assert(BIGINT_KARATSUBA_THRESHOLD >= 4 and
+                  BIGINT_KARATSUBA_SQR_THRESHOLD >= 4,
+              "Karatsuba does not shrink operands shorter than 4 limbs");
+
+// Process-wide counters behind BIGINT_STATS. Each routine counts its calls and
+// the limbs of its operands (the transform length for ntt). Allocations count
+// the limb buffers taken from the heap or a LimbAllocator, including the NTT
+// transform buffers and the root tables built on first use, but not the
+// blocks a LimbArena carves its buffers from. snapshot() and reset() exist in
+// every build, but without BIGINT_STATS the counters stay zero and the hooks
+// compile to nothing.
+class BigIntegerStats {
+ public:
+  enum Routine { add, subtract, multiply, square, divide, ntt, routineCount };
+
+  struct Snapshot {
+    uint64_t calls[routineCount];
+    uint64_t limbs[routineCount];
+    uint64_t allocations, allocatedBytes;
+  };
+
+  static const char* name(Routine routine);
+  static Snapshot snapshot();
+  static void reset();
+
+  static void record(Routine routine, uint64_t limbs) {
+    counters()[routine].fetch_add(1, std::memory_order_relaxed);
+    counters()[routineCount + routine].fetch_add(limbs,
+                                                 std::memory_order_relaxed);
+  }
+  static void recordAllocation(size_t limbs) {
+    counters()[2 * routineCount].fetch_add(1, std::memory_order_relaxed);
+    counters()[2 * routineCount + 1].fetch_add(limbs * sizeof(limb),
+                                               std::memory_order_relaxed);
+  }
+
+ private:
+  static std::atomic<uint64_t>* counters() {
+    static std::atomic<uint64_t> values[2 * routineCount + 2] = {};
+    return values;
+  }
+};
+
+#if BIGINT_STATS
+#define BIGINT_RECORD(routine, limbs) \
+  BigIntegerStats::record(BigIntegerStats::routine, limbs)
+#define BIGINT_RECORD_ALLOCATION(limbs) BigIntegerStats::recordAllocation(limbs)
+#else
+#define BIGINT_RECORD(routine, limbs)
+#define BIGINT_RECORD_ALLOCATION(limbs)
+#endif
+
+const char* BigIntegerStats::name(Routine routine) {
+  static const char* const names[] = {"add",    "subtract", "multiply",
+                                      "square", "divide",   "ntt"};
+  return names[routine];
+}
+
+BigIntegerStats::Snapshot BigIntegerStats::snapshot() {
+  Snapshot res;
+  for (int i = 0; i < routineCount; ++i) {
+    res.calls[i] = counters()[i].load(std::memory_order_relaxed);
+    res.limbs[i] = counters()[routineCount + i].load(std::memory_order_relaxed);
+  }
+  res.allocations = counters()[2 * routineCount].load(std::memory_order_relaxed);
+  res.allocatedBytes =
+      counters()[2 * routineCount + 1].load(std::memory_order_relaxed);
+  return res;
+}
+
+void BigIntegerStats::reset() {
+  for (int i = 0; i < 2 * routineCount + 2; ++i)
+    counters()[i].store(0, std::memory_order_relaxed);
+}
+
+std::ostream& operator<<(std::ostream& os,
+                         const BigIntegerStats::Snapshot& stats) {
+  for (int i = 0; i < BigIntegerStats::routineCount; ++i) {
+    os << BigIntegerStats::name(BigIntegerStats::Routine(i)) << ": "
+       << stats.calls[i] << " calls, " << stats.limbs[i] << " limbs\n";
+  }
+  return os << "allocations: " << stats.allocations << ", "
+            << stats.allocatedBytes << " bytes\n";
+}
+
+// Source of limb buffers for values created while it is installed with
+// LimbAllocatorScope on the current thread. Without a scope, buffers come
+// from new[] and delete[].
+class LimbAllocator {
+ public:
+  virtual ~LimbAllocator() = default;
+  virtual limb* allocate(size_t size) = 0;
+  virtual void deallocate(limb* buffer, size_t size) = 0;
+
+  // The allocator of the current thread, nullptr for the global heap.
+  static LimbAllocator*& current() {
+    static thread_local LimbAllocator* installed = nullptr;
+    return installed;
+  }
+};
+
+// Monotonic bump allocator for batches of computations. Buffers are carved
+// from blocks that are kept across reset(), so after the first batch a batch
+// does no heap allocation at all. Only the most recent buffer is reclaimed
+// when freed, which covers temporaries released right after use; everything
+// else waits for reset(). An arena serves a single thread, so nothing is
+// locked.
+class LimbArena : public LimbAllocator {
+ private:
+  std::vector<std::pair<limb*, size_t>> blocks;
+  size_t block, used;
+  limb* last;
+
+ public:
+  explicit LimbArena(size_t blockLimbs = size_t(1) << 16);
+  ~LimbArena();
+  LimbArena(const LimbArena&) = delete;
+  LimbArena& operator=(const LimbArena&) = delete;
+
+  limb* allocate(size_t size) override;
+  void deallocate(limb* buffer, size_t size) override;
+  // Makes all memory available again. Values created in the arena must be
+  // gone, or at least never touched again, by then.
+  void reset();
+};
+
+LimbArena::LimbArena(size_t blockLimbs) : block(0), used(0), last(nullptr) {
+  blocks.emplace_back(new limb[blockLimbs], blockLimbs);
+}
+
+LimbArena::~LimbArena() {
+  for (auto& b : blocks) delete[] b.first;
+}
+
+limb* LimbArena::allocate(size_t size) {
+  while (used + size > blocks[block].second) {
+    used = 0;
+    if (++block == blocks.size()) {
+      size_t grown = std::max(size, 2 * blocks.back().second);
+      blocks.emplace_back(new limb[grown], grown);
+    }
+  }
+  last = blocks[block].first + used;
+  used += size;
+  return last;
+}
+
+void LimbArena::deallocate(limb* buffer, size_t size) {
+  if (buffer == last) {
+    used -= size;
+    last = nullptr;
+  }
+}
+
+void LimbArena::reset() {
+  block = used = 0;
+  last = nullptr;
+}
+
+// Installs an allocator on the current thread for the lifetime of the scope;
+// nullptr selects the global heap. Values keep the allocator they were
+// created with, so a value created outside the scope never ends up holding
+// memory from inside it, even when it is assigned a result computed there.
+class LimbAllocatorScope {
+ private:
+  LimbAllocator* previous;
+
+ public:
+  explicit LimbAllocatorScope(LimbAllocator* allocator)
+      : previous(LimbAllocator::current()) {
+    LimbAllocator::current() = allocator;
+  }
+  ~LimbAllocatorScope() { LimbAllocator::current() = previous; }
+  LimbAllocatorScope(const LimbAllocatorScope&) = delete;
+  LimbAllocatorScope& operator=(const LimbAllocatorScope&) = delete;
+};
+
+// Limb storage that keeps up to inlineLimbs limbs inside the object, so values
+// that fit in a machine word never touch the heap. Longer values move to a
+// buffer from the allocator current at construction that grows geometrically,
+// like std::vector.
+class LimbVector {
+ private:
+  static constexpr size_t inlineLimbs = 2;
+
+  limb* storage;
+  size_t count;
+  size_t allocated;
+  LimbAllocator* allocator;
+  limb local[inlineLimbs];
+
+  bool isInline() const { return storage == local; }
+  void reallocate(size_t newCapacity);
+
+ public:
+  typedef limb* iterator;
+  typedef const limb* const_iterator;
+
+  LimbVector()
+      : storage(local),
+        count(0),
+        allocated(inlineLimbs),
+        allocator(LimbAllocator::current()){};
+  LimbVector(std::initializer_list<limb> init);
+  LimbVector(const LimbVector& other);
+  LimbVector(LimbVector&& other) noexcept;
+  ~LimbVector();
+
+  LimbVector& operator=(const LimbVector& other);
+  LimbVector& operator=(LimbVector&& other);
+
+  size_t size() const { return count; }
+  size_t capacity() const { return allocated; }
+  bool empty() const { return count == 0; }
+
+  limb* data() { return storage; }
+  const limb* data() const { return storage; }
+  limb& operator[](size_t idx) { return storage[idx]; }
+  limb operator[](size_t idx) const { return storage[idx]; }
+  limb& back() { return storage[count - 1]; }
+  limb back() const { return storage[count - 1]; }
+
+  iterator begin() { return storage; }
+  iterator end() { return storage + count; }
+  const_iterator begin() const { return storage; }
+  const_iterator end() const { return storage + count; }
+
+  void reserve(size_t newCapacity);
+  void resize(size_t newSize, limb value = 0);
+  void assign(size_t newSize, limb value);
+  void assign(const limb* first, const limb* last);
+  void push_back(limb value);
+  void pop_back() { --count; }
+  void insert(iterator pos, size_t n, limb value);
+  void erase(iterator first, iterator last);
+  void swap(LimbVector& other);
+};
+
+LimbVector::LimbVector(std::initializer_list<limb> init) : LimbVector() {
+  assign(init.begin(), init.end());
+}
+
+LimbVector::LimbVector(const LimbVector& other) : LimbVector() {
+  assign(other.begin(), other.end());
+}
+
+// A moved-from vector hands over its buffer together with its allocator.
+LimbVector::LimbVector(LimbVector&& other) noexcept : LimbVector() {
+  allocator = other.allocator;
+  swap(other);
+}
+
+LimbVector::~LimbVector() {
+  if (isInline()) return;
+  if (allocator) {
+    allocator->deallocate(storage, allocated);
+  } else {
+    delete[] storage;
+  }
+}
+
+LimbVector& LimbVector::operator=(const LimbVector& other) {
+  if (this != &other) assign(other.begin(), other.end());
+  return *this;
+}
+
+LimbVector& LimbVector::operator=(LimbVector&& other) {
+  if (this != &other) {
+    count = 0;
+    swap(other);
+  }
+  return *this;
+}
+
+void LimbVector::reallocate(size_t newCapacity) {
+  limb* old = storage;
+  size_t oldCapacity = allocated;
+  if (newCapacity <= inlineLimbs) {
+    storage = local;
+  } else {
+    BIGINT_RECORD_ALLOCATION(newCapacity);
+    storage = allocator ? allocator->allocate(newCapacity)
+                        : new limb[newCapacity];
+  }
+  if (storage != old) std::copy(old, old + count, storage);
+  if (old != local) {
+    if (allocator) {
+      allocator->deallocate(old, oldCapacity);
+    } else {
+      delete[] old;
+    }
+  }
+  allocated = newCapacity > inlineLimbs ? newCapacity : inlineLimbs;
+}
+
+void LimbVector::reserve(size_t newCapacity) {
+  if (newCapacity > allocated) reallocate(newCapacity);
+}
+
+void LimbVector::resize(size_t newSize, limb value) {
+  if (newSize > allocated) reallocate(std::max(newSize, 2 * allocated));
+  if (newSize > count) std::fill(storage + count, storage + newSize, value);
+  count = newSize;
+}
+
+void LimbVector::assign(size_t newSize, limb value) {
+  count = 0;
+  resize(newSize, value);
+}
+
+void LimbVector::assign(const limb* first, const limb* last) {
+  size_t newSize = last - first;
+  if (newSize > allocated) {
+    count = 0;
+    reallocate(newSize);
+  }
+  std::copy(first, last, storage);
+  count = newSize;
+}
+
+void LimbVector::push_back(limb value) {
+  if (count == allocated) reallocate(2 * allocated);
+  storage[count++] = value;
+}
+
+void LimbVector::insert(iterator pos, size_t n, limb value) {
+  size_t offset = pos - storage;
+  if (count + n > allocated) reallocate(std::max(count + n, 2 * allocated));
+  std::copy_backward(storage + offset, storage + count, storage + count + n);
+  std::fill(storage + offset, storage + offset + n, value);
+  count += n;
+}
+
+void LimbVector::erase(iterator first, iterator last) {
+  std::copy(last, end(), first);
+  count -= last - first;
+}
+
+// Heap buffers are exchanged by pointer; inline contents have to be copied,
+// and so do the contents of vectors with different allocators, which keep
+// their own.
+void LimbVector::swap(LimbVector& other) {
+  if (allocator != other.allocator) {
+    LimbVector copy;
+    copy.allocator = allocator;
+    copy.assign(begin(), end());
+    assign(other.begin(), other.end());
+    other.assign(copy.begin(), copy.end());
+    return;
+  }
+  if (!isInline() and !other.isInline()) {
+    std::swap(storage, other.storage);
+  } else if (isInline() and other.isInline()) {
+    std::swap(local, other.local);
+  } else {
+    LimbVector& onHeap = isInline() ? other : *this;
+    LimbVector& inlined = isInline() ? *this : other;
+    std::copy(inlined.local, inlined.local + inlined.count, onHeap.local);
+    inlined.storage = onHeap.storage;
+    onHeap.storage = onHeap.local;
+  }
+  std::swap(count, other.count);
+  std::swap(allocated, other.allocated);
+}
+
+// Persistent worker threads for the parallel parts of multiplication. A job
+// is a loop over independent iterations that the workers and the calling
+// thread share; a job started from inside another one runs serially, and so
+// does one started while another thread's job is in flight.
+class BigIntegerThreadPool {
+ private:
+  std::vector<std::thread> workers;
+  std::mutex lock, runLock;
+  std::condition_variable wake, done;
+  const std::function<void(size_t)>* job;
+  size_t jobSize, pending, generation;
+  std::atomic<size_t> next;
+  bool stopping;
+
+  BigIntegerThreadPool();
+
+  static bool& insideJob();
+  void work(size_t seen);
+  void runIterations();
+  void stop();
+
+ public:
+  ~BigIntegerThreadPool() { stop(); }
+
+  static BigIntegerThreadPool& instance();
+
+  size_t threads() const { return workers.size() + 1; }
+  void setThreads(size_t count);
+  void run(size_t size, const std::function<void(size_t)>& body);
+};
+
+BigIntegerThreadPool::BigIntegerThreadPool()
+    : job(nullptr), jobSize(0), pending(0), generation(0), next(0),
+      stopping(false) {
+  setThreads(BIGINT_THREADS);
+}
+
+BigIntegerThreadPool& BigIntegerThreadPool::instance() {
+  static BigIntegerThreadPool pool;
+  return pool;
+}
+
+bool& BigIntegerThreadPool::insideJob() {
+  static thread_local bool inside = false;
+  return inside;
+}
+
+// Counts the calling thread, so 1 means no workers. Must not be called while
+// a multiplication is running.
+void BigIntegerThreadPool::setThreads(size_t count) {
+  stop();
+  size_t current;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = false;
+    current = generation;
+  }
+  // New workers wait for the next job, not for the ones that already ran.
+  for (size_t i = 1; i < count; ++i)
+    workers.emplace_back([this, current] { work(current); });
+}
+
+void BigIntegerThreadPool::stop() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers) worker.join();
+  workers.clear();
+}
+
+void BigIntegerThreadPool::runIterations() {
+  for (size_t i; (i = next++) < jobSize;) (*job)(i);
+}
+
+void BigIntegerThreadPool::work(size_t seen) {
+  insideJob() = true;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [&] { return stopping or generation != seen; });
+      if (stopping) return;
+      seen = generation;
+    }
+    runIterations();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (--pending == 0) done.notify_one();
+    }
+  }
+}
+
+// Calls body(i) for every i < size and returns when all calls are done.
+void BigIntegerThreadPool::run(size_t size,
+                               const std::function<void(size_t)>& body) {
+  std::unique_lock<std::mutex> running(runLock, std::defer_lock);
+  if (workers.empty() or size < 2 or insideJob() or !running.try_lock()) {
+    for (size_t i = 0; i < size; ++i) body(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    job = &body;
+    jobSize = size;
+    next = 0;
+    pending = workers.size();
+    ++generation;
+  }
+  wake.notify_all();
+
+  insideJob() = true;
+  runIterations();
+  insideJob() = false;
+
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [&] { return pending == 0; });
+  job = nullptr;
+}
+
+class BigInteger;
+
+// Read-only signed value over limbs owned elsewhere, e.g. a memory-mapped
+// file written through BigInteger::view(). Nothing is copied: the limbs must
+// outlive the view and stay unchanged while it is used. Leading zero limbs
+// are skipped, so a fixed-size buffer can be wrapped as is.
+//
+// compare, +, - and * read the limbs in place; divmod and toString copy the
+// operands into a BigInteger first, as their BigInteger kernels work on a
+// normalized copy anyway.
+class BigIntegerView {
+  friend class BigInteger;
+
+ private:
+  const limb* data;
+  size_t count;
+  bool negative;
+
+  int compareAbs(const BigIntegerView& right) const;
+
+ public:
+  BigIntegerView(const limb* limbs, size_t size, bool isNegative = false);
+  // Explicit, so that a temporary cannot silently become a dangling view;
+  // BigInteger::view() is the usual way to get one.
+  explicit BigIntegerView(const BigInteger& value);
+
+  const limb* limbs() const { return data; }
+  size_t size() const { return count; }
+  bool isNegative() const { return negative; }
+  size_t bitLength() const;
+
+  // -1, 0 or 1 as this is less than, equal to or greater than right.
+  int compare(const BigIntegerView& right) const;
+  std::string toString() const;
+};
 
 class BigInteger {
+  friend struct BigIntegerTuning;
+  friend class BigIntegerView;
+
  private:
-  std::vector<long long> digits;
-  bool sign;  // 1 = '+', 0 = '-'
-  long long base = 100;
+  LimbVector digits;  // base 2^32, least significant limb first
+  bool sign;          // 1 = '+', 0 = '-'
+
+  static constexpr int limbBits = 32;
+  static constexpr limb decimalBase = 1000000000;  // 10^9 fits in one limb
+  static constexpr int decimalBaseDigits = 9;
 
   bool isZero() const;
   void removeLeadingZeros();
+  int compareAbs(const BigInteger& right) const;
+  bool testBit(size_t index) const;
+  BigInteger lowLimbs(size_t count) const;
+  BigInteger highLimbs(size_t from) const;
+  void shiftLimbsLeft(size_t count);
+  void shiftLeft(size_t bits);
+  void shiftRight(size_t bits);
   void addOne();
   void subtractOne();
   void addPositive(const BigInteger& a);
   void subtractPositive(const BigInteger& a);
-  int reverseBits(int idx, int lg);
-  int lgBase();
-  void fft(std::vector<comp>& a, bool invert);
+  template <typename Op>
+  void bitwise(const BigInteger& right, Op op);
+
+  // Three-prime number-theoretic transform. Every prime supports transforms
+  // up to nttMaxSize and their product bounds the convolution terms exactly.
+  static constexpr limb nttPrime0 = 469762049;   // 7 * 2^26 + 1
+  static constexpr limb nttPrime1 = 1811939329;  // 27 * 2^26 + 1
+  static constexpr limb nttPrime2 = 2013265921;  // 15 * 2^27 + 1
+  static constexpr int nttMaxLog = 26;
+  static constexpr size_t nttMaxSize = size_t(1) << nttMaxLog;
+
+  template <limb mod>
+  static limb powMod(limb base, limb exp);
+  // Twiddle factors of one butterfly stage with Shoup's precomputed quotients
+  // w * 2^32 / mod, which reduce t * w modulo mod with two 32-bit products
+  // and no division.
+  struct NttRoots {
+    std::vector<limb> roots, quotients;
+  };
+  typedef void (*ButterflyKernel)(limb* x, size_t len, const limb* w,
+                                  const limb* wq, size_t count, limb mod);
+
+  template <limb mod, limb root>
+  static const NttRoots& nttRoots(size_t logLen);
+  static void butterfliesScalar(limb* x, size_t len, const limb* w,
+                                const limb* wq, size_t count, limb mod);
+#if defined(__x86_64__) || defined(__i386__)
+  static void butterfliesAvx2(limb* x, size_t len, const limb* w,
+                              const limb* wq, size_t count, limb mod);
+  static void butterfliesAvx512(limb* x, size_t len, const limb* w,
+                                const limb* wq, size_t count, limb mod);
+#endif
+  static ButterflyKernel butterflyKernel();
+  template <typename Body>
+  static void forRange(size_t size, bool parallel, Body body);
+  template <limb mod, limb root>
+  static void ntt(LimbVector& a, bool invert, bool parallel);
+  template <limb mod, limb root>
+  static void nttConvolve(const limb* a, size_t n, const limb* b, size_t m,
+                          LimbVector& fa, LimbVector& fb, bool parallel);
+  static void nttMultiply(const limb* a, size_t n, const limb* b, size_t m,
+                          limb* res);
+
+  // Raw limb kernels. Products write n + m limbs to res, which must not
+  // overlap the operands.
+  static limb addLimbs(limb* res, const limb* a, size_t n, const limb* b,
+                       size_t m);
+  static limb subLimbs(limb* res, const limb* a, size_t n, const limb* b,
+                       size_t m);
+  static void mulSchoolbook(const limb* a, size_t n, const limb* b, size_t m,
+                            limb* res);
+  static void sqrSchoolbook(const limb* a, size_t n, limb* res);
+  static void squareLimbs(const limb* a, size_t n, limb* res);
+  static void mulKaratsuba(const limb* a, size_t n, const limb* b, size_t m,
+                           limb* res);
+  static void mulToom3(const limb* a, size_t n, const limb* b, size_t m,
+                       limb* res);
+  static void multiplyLimbs(const limb* a, size_t n, const limb* b, size_t m,
+                            limb* res);
+  static BigInteger fromLimbs(const limb* a, size_t n);
+  static BigInteger addViews(const BigIntegerView& left,
+                             const BigIntegerView& right, bool subtract);
+  static void multiply(const BigInteger& a, const BigInteger& b,
+                       BigInteger& res);
+  static void addProduct(BigInteger& acc, const BigInteger& a,
+                         const BigInteger& b, bool subtract);
+  static void squareInto(const BigInteger& a, BigInteger& res);
+  template <typename Multiply, typename Square>
+  static BigInteger windowPow(const BigInteger& base, const BigInteger& exp,
+                              const BigInteger& one, Multiply multiply,
+                              Square square);
   void multOnBigInt(const BigInteger& arg);
   void multOnInt(long long a);
+
+  // Division by one limb with Moller and Granlund's precomputed reciprocal:
+  // the divisor is shifted until its top bit is set and inverse is
+  // floor((B^2 - 1) / normalized) - B, so every quotient limb costs two
+  // multiplications instead of a hardware division.
+  struct LimbDivisor {
+    limb normalized, inverse;
+    int shift;
+
+    explicit LimbDivisor(limb divisor);
+    limb divide(limb high, limb low, limb& rem) const;
+  };
+  static limb divLimbs(limb* q, const limb* a, size_t n, const LimbDivisor& d);
+  void mulAddSmall(limb factor, limb addend);
+  limb divSmall(const LimbDivisor& divisor);
+
+  static const BigInteger& decimalPower(size_t level);
+  static void emit(std::string& out, const char* text, size_t len);
+  static void emit(std::ostream& out, const char* text, size_t len);
+  template <typename Sink>
+  static void writeDecimal(const BigInteger& x, size_t width, Sink& out);
+  static BigInteger parseDecimal(const char* text, size_t len);
+
+  uint64_t bitsFrom(size_t shift) const;
+  static uint64_t binaryGcd(uint64_t a, uint64_t b);
+  static bool lehmerCofactors(const BigInteger& x, const BigInteger& y,
+                              int64_t cofactors[4]);
+  static void applyCofactors(BigInteger& x, BigInteger& y,
+                             const int64_t cofactors[4]);
+  static void hgcdReduce(BigInteger& a, BigInteger& b, BigInteger* matrix);
+
+  // Division on magnitudes. All of them leave a / b in q and a % b in r.
+  // cutoff is the length below which the recursive algorithms stop
+  // recursing; only bench/bigint_tune.cpp passes other values than the
+  // compiled thresholds.
+  static void divSchoolbook(const BigInteger& a, const BigInteger& b,
+                            BigInteger& q, BigInteger& r);
+  static void divTwoByOne(const BigInteger& a, const BigInteger& b, size_t n,
+                          BigInteger& q, BigInteger& r, size_t cutoff);
+  static void divThreeByTwo(const BigInteger& a, const BigInteger& b,
+                            size_t half, BigInteger& q, BigInteger& r,
+                            size_t cutoff);
+  static void divBurnikelZiegler(const BigInteger& a, const BigInteger& b,
+                                 BigInteger& q, BigInteger& r,
+                                 size_t cutoff = BIGINT_BZ_THRESHOLD);
+  static BigInteger reciprocal(const BigInteger& b,
+                               size_t cutoff = BIGINT_NEWTON_THRESHOLD);
+  static void divNewton(const BigInteger& a, const BigInteger& b,
+                        BigInteger& q, BigInteger& r,
+                        size_t cutoff = BIGINT_NEWTON_THRESHOLD);
+  void divModAbs(const BigInteger& right, BigInteger& q, BigInteger& r) const;
   void devide(const BigInteger& right, bool mode);
 
  public:
   BigInteger() : digits({0}), sign(1){};
 
   BigInteger(long long n);
+  explicit BigInteger(const BigIntegerView& view);
 
   std::string toString() const;
 
   bool less(const BigInteger& right) const;
   bool equal(const BigInteger& right) const;
+  // -1, 0 or 1 as this is less than, equal to or greater than right.
+  int compare(const BigInteger& right) const;
 
   BigInteger abs() const;
+  BigInteger square() const;
+
+  // Word-sized arithmetic in a single pass over the limbs. mulSmall and
+  // addSmall act like *= and +=; divSmall truncates like /= and returns the
+  // magnitude of the remainder, which modSmall returns without changing the
+  // value. A zero divisor stops the program.
+  BigInteger& mulSmall(limb factor);
+  BigInteger& addSmall(limb value);
+  limb divSmall(limb divisor);
+  limb modSmall(limb divisor) const;
+
+  // Two's-complement bytes of the smallest length that keeps the sign bit,
+  // as Java's BigInteger.toByteArray and Python's int.to_bytes(signed=True)
+  // use them. importBytes reads any such encoding, sign-extended or not;
+  // an empty buffer is zero.
+  std::vector<uint8_t> exportBytes(
+      ByteOrder order = ByteOrder::littleEndian) const;
+  static BigInteger importBytes(const uint8_t* bytes, size_t size,
+                                ByteOrder order = ByteOrder::littleEndian);
+
+  // Limbs of the magnitude, least significant first, valid until the value
+  // is next modified.
+  BigIntegerView view() const;
+
+  // Bit queries on the magnitude: bitLength is the position of the highest
+  // set bit plus one, trailingZeros the position of the lowest; both are 0
+  // for zero.
+  size_t bitLength() const;
+  size_t popCount() const;
+  size_t trailingZeros() const;
+
+  // Number of threads, the caller included, that share the transforms of
+  // products above BIGINT_PARALLEL_THRESHOLD limbs. Defaults to BIGINT_THREADS.
+  static void setThreadCount(size_t count);
+  static size_t threadCount();
 
   BigInteger operator-();
   BigInteger& operator++();
@@ -50,25 +842,157 @@ class BigInteger {
   BigInteger& operator/=(const BigInteger& right);
   BigInteger& operator%=(const BigInteger& right);
 
+  // Bitwise operators act on the infinite two's-complement form, so negative
+  // values behave like machine integers: ~x == -x - 1 and x >> k rounds
+  // toward minus infinity. Shifts move limbs directly in O(n).
+  BigInteger operator~() const;
+  BigInteger& operator&=(const BigInteger& right);
+  BigInteger& operator|=(const BigInteger& right);
+  BigInteger& operator^=(const BigInteger& right);
+  BigInteger& operator<<=(size_t bits);
+  BigInteger& operator>>=(size_t bits);
+
   explicit operator bool() const;
 
+  friend std::ostream& operator<<(std::ostream& os, const BigInteger& s);
   friend std::istream& operator>>(std::istream& is, BigInteger& s);
+  friend std::pair<BigInteger, BigInteger> divmod(const BigInteger& left,
+                                                  const BigInteger& right);
+  friend BigInteger gcd(const BigInteger& left, const BigInteger& right);
+  friend BigInteger operator*(const BigInteger& left, const BigInteger& right);
+  friend BigInteger operator-(const BigInteger& left, BigInteger&& right);
+  friend void addMul(BigInteger& acc, const BigInteger& a,
+                     const BigInteger& b);
+  friend void subMul(BigInteger& acc, const BigInteger& a,
+                     const BigInteger& b);
+  friend BigInteger pow(const BigInteger& base, uint64_t exp);
+  friend BigInteger iroot(const BigInteger& x, limb n);
+  friend BigInteger operator*(const BigIntegerView& left,
+                              const BigIntegerView& right);
+  friend BigInteger operator+(const BigIntegerView& left,
+                              const BigIntegerView& right);
+  friend BigInteger operator-(const BigIntegerView& left,
+                              const BigIntegerView& right);
+  friend class ModularContext;
 };
 
 BigInteger::BigInteger(long long n) {
-  sign = 1;
+  sign = n >= 0;
 
-  if (n < 0) {
-    sign = 0;
-    n *= -1;
+  unsigned long long magnitude = n;
+  if (n < 0) magnitude = 0ull - magnitude;
+
+  if (magnitude == 0) digits.push_back(0);
+
+  while (magnitude) {
+    digits.push_back(static_cast<limb>(magnitude));
+    magnitude >>= limbBits;
+  }
+}
+
+BigInteger::BigInteger(const BigIntegerView& view) : sign(1) {
+  if (view.size()) {
+    digits.assign(view.limbs(), view.limbs() + view.size());
+    sign = !view.isNegative();
+  } else {
+    digits.push_back(0);
+  }
+}
+
+BigIntegerView::BigIntegerView(const limb* limbs, size_t size,
+                               bool isNegative)
+    : data(limbs), count(size), negative(isNegative) {
+  while (count and !data[count - 1]) --count;
+  if (!count) negative = false;
+}
+
+BigIntegerView::BigIntegerView(const BigInteger& value)
+    : data(value.digits.data()),
+      count(value.isZero() ? 0 : value.digits.size()),
+      negative(!value.sign) {}
+
+size_t BigIntegerView::bitLength() const {
+  if (!count) return 0;
+  return count * BigInteger::limbBits - __builtin_clz(data[count - 1]);
+}
+
+BigIntegerView BigInteger::view() const { return BigIntegerView(*this); }
+
+int BigIntegerView::compareAbs(const BigIntegerView& right) const {
+  if (count != right.count) return count < right.count ? -1 : 1;
+  for (size_t i = count; i-- > 0;) {
+    if (data[i] != right.data[i]) return data[i] < right.data[i] ? -1 : 1;
   }
+  return 0;
+}
+
+int BigIntegerView::compare(const BigIntegerView& right) const {
+  if (negative != right.negative) return negative ? -1 : 1;
+  int cmp = compareAbs(right);
+  return negative ? -cmp : cmp;
+}
 
-  if (n == 0) digits.push_back(0);
+std::string BigIntegerView::toString() const {
+  return BigInteger(*this).toString();
+}
 
-  while (n) {
-    digits.push_back(n % base);
-    n /= base;
+// left + right, or left - right when subtract is set, with one carry pass
+// over the limbs of both views straight into the result.
+BigInteger BigInteger::addViews(const BigIntegerView& left,
+                                const BigIntegerView& right, bool subtract) {
+  const BigIntegerView* a = &left;
+  const BigIntegerView* b = &right;
+  bool negativeA = left.isNegative();
+  bool negativeB = right.isNegative() != subtract;
+  BigInteger res;
+
+  if (negativeA == negativeB) {
+    BIGINT_RECORD(add, a->size() + b->size());
+    if (a->size() < b->size()) std::swap(a, b);
+    res.digits.resize(a->size() + 1);
+    res.digits[a->size()] = addLimbs(res.digits.data(), a->limbs(), a->size(),
+                                     b->limbs(), b->size());
+    res.sign = !negativeA;
+  } else {
+    BIGINT_RECORD(subtract, a->size() + b->size());
+    // The larger magnitude gives the sign, as in subtractPositive.
+    int cmp = a->compareAbs(*b);
+    if (cmp == 0) return res;
+    if (cmp < 0) {
+      std::swap(a, b);
+      std::swap(negativeA, negativeB);
+    }
+    res.digits.resize(a->size());
+    subLimbs(res.digits.data(), a->limbs(), a->size(), b->limbs(), b->size());
+    res.sign = !negativeA;
   }
+
+  res.removeLeadingZeros();
+  return res;
+}
+
+BigInteger operator+(const BigIntegerView& left, const BigIntegerView& right) {
+  return BigInteger::addViews(left, right, false);
+}
+
+BigInteger operator-(const BigIntegerView& left, const BigIntegerView& right) {
+  return BigInteger::addViews(left, right, true);
+}
+
+// Product of two views straight from their limbs, without copying either
+// operand into a BigInteger first.
+BigInteger operator*(const BigIntegerView& left, const BigIntegerView& right) {
+  BigInteger res;
+  size_t n = left.size(), m = right.size();
+  if (!n or !m) return res;
+  BIGINT_RECORD(multiply, n + m);
+
+  res.digits.resize(n + m);
+  BigInteger::multiplyLimbs(left.limbs(), n, right.limbs(), m,
+                            res.digits.data());
+  res.sign = left.isNegative() == right.isNegative();
+  res.removeLeadingZeros();
+  return res;
 }
 
 bool operator==(const BigInteger& left, const BigInteger& right) {
@@ -80,20 +1004,27 @@ bool operator!=(const BigInteger& left, const BigInteger& right) {
 }
 
 bool operator<(const BigInteger& left, const BigInteger& right) {
-  return left.less(right);
+  return left.compare(right) < 0;
 }
 
 bool operator>(const BigInteger& left, const BigInteger& right) {
-  return right.less(left);
+  return left.compare(right) > 0;
 }
 
 bool operator<=(const BigInteger& left, const BigInteger& right) {
-  return left.less(right) || left.equal(right);
+  return left.compare(right) <= 0;
 }
 
 bool operator>=(const BigInteger& left, const BigInteger& right) {
-  return right.less(left) or right.equal(left);
+  return left.compare(right) >= 0;
+}
+
+#if __cplusplus >= 202002L
+std::strong_ordering operator<=>(const BigInteger& left,
+                                 const BigInteger& right) {
+  return left.compare(right) <=> 0;
 }
+#endif
 
 BigInteger operator+(const BigInteger& left, const BigInteger& right) {
   BigInteger res = left;
@@ -108,8 +1039,8 @@ BigInteger operator-(const BigInteger& left, const BigInteger& right) {
 }
 
 BigInteger operator*(const BigInteger& left, const BigInteger& right) {
-  BigInteger res = left;
-  res *= right;
+  BigInteger res;
+  BigInteger::multiply(left, right, res);
   return res;
 }
 
@@ -125,455 +1056,2590 @@ BigInteger operator%(const BigInteger& left, const BigInteger& right) {
   return res;
 }
 
-std::ostream& operator<<(std::ostream& os, const BigInteger& a) {
-  os << a.toString();
-  return os;
+BigInteger operator&(const BigInteger& left, const BigInteger& right) {
+  BigInteger res = left;
+  res &= right;
+  return res;
 }
 
-std::istream& operator>>(std::istream& is, BigInteger& a) {
-  std::string num;
-  is >> num;
-  a.digits.clear();
-  a.sign = 1;
+BigInteger operator|(const BigInteger& left, const BigInteger& right) {
+  BigInteger res = left;
+  res |= right;
+  return res;
+}
 
-  int beg = 0;
-  if (num[0] == '-') beg = 1;
+BigInteger operator^(const BigInteger& left, const BigInteger& right) {
+  BigInteger res = left;
+  res ^= right;
+  return res;
+}
 
-  int cur = 0;
-  int deg = 1;
-  for (int i = num.size() - 1; i >= beg; --i) {
-    cur += (num[i] - '0') * deg;
-    deg *= 10;
-    if ((num.size() - i) % 2 == 0) {  // base!!!!!
-      a.digits.push_back(cur);
-      cur = 0;
-      deg = 1;
-    }
-  }
+BigInteger operator<<(const BigInteger& left, size_t bits) {
+  BigInteger res = left;
+  res <<= bits;
+  return res;
+}
 
-  a.digits.push_back(cur);
+BigInteger operator>>(const BigInteger& left, size_t bits) {
+  BigInteger res = left;
+  res >>= bits;
+  return res;
+}
 
-  while (a.digits.size() > 1 && !a.digits.back()) {
-    a.digits.pop_back();
-  }
+// Temporaries are updated in place and moved out, so a chain like
+// a * b + c * d - e allocates only for the products.
+BigInteger operator+(BigInteger&& left, const BigInteger& right) {
+  left += right;
+  return std::move(left);
+}
 
-  if (!a.isZero() and beg) a.sign = 0;
+BigInteger operator+(const BigInteger& left, BigInteger&& right) {
+  right += left;
+  return std::move(right);
+}
 
-  return is;
+BigInteger operator+(BigInteger&& left, BigInteger&& right) {
+  left += right;
+  return std::move(left);
 }
 
-bool BigInteger::isZero() const { return digits.size() == 1 and !digits[0]; }
+BigInteger operator-(BigInteger&& left, const BigInteger& right) {
+  left -= right;
+  return std::move(left);
+}
 
-void BigInteger::removeLeadingZeros() {
-  while (digits.size() > 1 && !digits.back()) {
-    digits.pop_back();
-  }
+BigInteger operator-(const BigInteger& left, BigInteger&& right) {
+  right -= left;
+  if (!right.isZero()) right.sign ^= 1;
+  return std::move(right);
 }
 
-void BigInteger::addOne() {
-  digits[0] += 1;
-  for (size_t i = 0; i < digits.size(); ++i) {
-    if (digits[i] < base) return;
-    if (i + 1 == digits.size()) {
-      digits.push_back(digits[i] / base);
-    } else {
-      digits[i + 1] += digits[i] / base;
-    }
-    digits[i] %= base;
-  }
+BigInteger operator-(BigInteger&& left, BigInteger&& right) {
+  left -= right;
+  return std::move(left);
 }
 
-void BigInteger::subtractOne() {
-  if (isZero()) {
-    sign = 0;
-    digits[0] = 1;
-  } else {
-    digits[0] -= 1;
-    for (size_t i = 0; i < digits.size(); ++i) {
-      if (digits[i] >= 0) break;
-      digits[i] += base;
-      digits[i + 1] -= 1;
-    }
-  }
+BigInteger operator*(BigInteger&& left, const BigInteger& right) {
+  left *= right;
+  return std::move(left);
+}
 
-  while (digits.size() > 1 and digits.back() == 0) digits.pop_back();
+BigInteger operator*(const BigInteger& left, BigInteger&& right) {
+  right *= left;
+  return std::move(right);
+}
 
-  if (isZero()) sign = 1;
+BigInteger operator*(BigInteger&& left, BigInteger&& right) {
+  left *= right;
+  return std::move(left);
 }
 
-void BigInteger::addPositive(const BigInteger& right) {
-  for (size_t i = 0; i < right.digits.size(); ++i) {
-    if (i < digits.size()) {
-      digits[i] += right.digits[i];
-    } else {
-      digits.push_back(right.digits[i]);
-    }
-  }
+BigInteger operator/(BigInteger&& left, const BigInteger& right) {
+  left /= right;
+  return std::move(left);
+}
 
-  for (size_t i = 0; i < digits.size(); ++i) {
-    if (digits[i] >= base) {
-      if (i + 1 == digits.size()) {
-        digits.push_back(digits[i] / base);
-      } else {
-        digits[i + 1] += digits[i] / base;
-      }
+BigInteger operator%(BigInteger&& left, const BigInteger& right) {
+  left %= right;
+  return std::move(left);
+}
 
-      digits[i] %= base;
-    }
-  }
+BigInteger operator&(BigInteger&& left, const BigInteger& right) {
+  left &= right;
+  return std::move(left);
 }
 
-void BigInteger::subtractPositive(const BigInteger& right) {
-  for (size_t i = 0; i < right.digits.size(); ++i) {
-    if (i < digits.size()) {
-      digits[i] -= right.digits[i];
-    } else {
-      digits.push_back(-right.digits[i]);
-    }
-  }
+BigInteger operator&(const BigInteger& left, BigInteger&& right) {
+  right &= left;
+  return std::move(right);
+}
 
-  long long resultSign = 1;
-  for (size_t i = 0; i < digits.size(); ++i) {
-    if (digits[i] < 0) resultSign = -1;
-    if (digits[i] > 0) resultSign = 1;
-  }
+BigInteger operator&(BigInteger&& left, BigInteger&& right) {
+  left &= right;
+  return std::move(left);
+}
 
-  if (resultSign == -1) sign ^= 1;
+BigInteger operator|(BigInteger&& left, const BigInteger& right) {
+  left |= right;
+  return std::move(left);
+}
 
-  for (size_t i = 0; i < digits.size(); ++i) {
-    digits[i] *= resultSign;
-  }
+BigInteger operator|(const BigInteger& left, BigInteger&& right) {
+  right |= left;
+  return std::move(right);
+}
 
-  for (size_t i = 0; i + 1 < digits.size(); ++i) {
-    if (digits[i] < 0) {
-      digits[i + 1]--;
-      digits[i] += base;
-    }
-  }
+BigInteger operator|(BigInteger&& left, BigInteger&& right) {
+  left |= right;
+  return std::move(left);
+}
+
+BigInteger operator^(BigInteger&& left, const BigInteger& right) {
+  left ^= right;
+  return std::move(left);
+}
+
+BigInteger operator^(const BigInteger& left, BigInteger&& right) {
+  right ^= left;
+  return std::move(right);
+}
+
+BigInteger operator^(BigInteger&& left, BigInteger&& right) {
+  left ^= right;
+  return std::move(left);
+}
+
+BigInteger operator<<(BigInteger&& left, size_t bits) {
+  left <<= bits;
+  return std::move(left);
+}
+
+BigInteger operator>>(BigInteger&& left, size_t bits) {
+  left >>= bits;
+  return std::move(left);
+}
+
+// acc += a * b and acc -= a * b. The product goes to a per-thread scratch
+// value whose buffer is kept between calls, so accumulation loops do not
+// allocate once the scratch has grown to the working size.
+void addMul(BigInteger& acc, const BigInteger& a, const BigInteger& b) {
+  BigInteger::addProduct(acc, a, b, false);
+}
+
+void subMul(BigInteger& acc, const BigInteger& a, const BigInteger& b) {
+  BigInteger::addProduct(acc, a, b, true);
+}
+
+// Quotient and remainder of one division. The quotient is truncated toward
+// zero and the remainder takes the sign of left, as with / and %.
+std::pair<BigInteger, BigInteger> divmod(const BigInteger& left,
+                                         const BigInteger& right) {
+  std::pair<BigInteger, BigInteger> res;
+  left.divModAbs(right, res.first, res.second);
+
+  if (!res.first.isZero()) res.first.sign = (left.sign == right.sign);
+
+  if (!res.second.isZero()) res.second.sign = left.sign;
+
+  return res;
+}
+
+std::pair<BigInteger, BigInteger> divmod(const BigIntegerView& left,
+                                         const BigIntegerView& right) {
+  return divmod(BigInteger(left), BigInteger(right));
+}
+
+std::ostream& operator<<(std::ostream& os, const BigInteger& a) {
+  // Padded output goes through toString so that the stream width applies.
+  if (os.width() != 0) return os << a.toString();
+
+  if (!a.sign) os << '-';
+  BigInteger::writeDecimal(a, 0, os);
+  return os;
+}
+
+std::istream& operator>>(std::istream& is, BigInteger& a) {
+  std::string num;
+  is >> num;
+
+  size_t beg = 0;
+  if (!num.empty() and num[0] == '-') beg = 1;
+
+  a = BigInteger::parseDecimal(num.data() + beg, num.size() - beg);
+
+  if (!a.isZero() and beg) a.sign = 0;
+
+  return is;
+}
+
+bool BigInteger::isZero() const { return digits.size() == 1 and !digits[0]; }
+
+void BigInteger::removeLeadingZeros() {
+  while (digits.size() > 1 && !digits.back()) {
+    digits.pop_back();
+  }
+}
+
+int BigInteger::compareAbs(const BigInteger& right) const {
+  if (digits.size() != right.digits.size())
+    return digits.size() < right.digits.size() ? -1 : 1;
+  for (size_t i = digits.size(); i-- > 0;) {
+    if (digits[i] != right.digits[i]) return digits[i] < right.digits[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+size_t BigInteger::bitLength() const {
+  if (isZero()) return 0;
+  return digits.size() * limbBits - __builtin_clz(digits.back());
+}
+
+std::vector<uint8_t> BigInteger::exportBytes(ByteOrder order) const {
+  // A negative power of two needs no extra byte for its sign: -128 is 0x80.
+  size_t bits = bitLength();
+  if (!sign and trailingZeros() + 1 == bits) --bits;
+  std::vector<uint8_t> bytes(bits / 8 + 1);
+
+  limb carry = 1;
+  for (size_t i = 0; i < digits.size() and i * 4 < bytes.size(); ++i) {
+    limb d = digits[i];
+    if (!sign) {
+      d = ~d + carry;
+      carry &= d == 0;
+    }
+    for (size_t k = 0; k < 4 and i * 4 + k < bytes.size(); ++k)
+      bytes[i * 4 + k] = static_cast<uint8_t>(d >> (8 * k));
+  }
+  // The magnitude may end below the last byte, which then holds the sign.
+  if (!sign and digits.size() * 4 < bytes.size()) bytes.back() = 0xff;
+
+  if (order == ByteOrder::bigEndian) std::reverse(bytes.begin(), bytes.end());
+  return bytes;
+}
+
+BigInteger BigInteger::importBytes(const uint8_t* bytes, size_t size,
+                                   ByteOrder order) {
+  BigInteger res;
+  if (!size) return res;
+
+  auto byteAt = [&](size_t i) {
+    return order == ByteOrder::littleEndian ? bytes[i] : bytes[size - 1 - i];
+  };
+  bool negative = byteAt(size - 1) & 0x80;
+  res.digits.resize((size + 3) / 4);
+
+  limb carry = 1;
+  for (size_t i = 0; i < res.digits.size(); ++i) {
+    limb d = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      limb b = i * 4 + k < size ? byteAt(i * 4 + k) : negative ? 0xff : 0;
+      d |= b << (8 * k);
+    }
+    if (negative) {
+      d = ~d + carry;
+      carry &= d == 0;
+    }
+    res.digits[i] = d;
+  }
+
+  res.removeLeadingZeros();
+  res.sign = !negative or res.isZero();
+  return res;
+}
+
+size_t BigInteger::popCount() const {
+  size_t count = 0;
+  for (limb d : digits) count += __builtin_popcount(d);
+  return count;
+}
+
+size_t BigInteger::trailingZeros() const {
+  if (isZero()) return 0;
+  size_t i = 0;
+  while (digits[i] == 0) ++i;
+  return i * limbBits + __builtin_ctz(digits[i]);
+}
+
+bool BigInteger::testBit(size_t index) const {
+  size_t position = index / limbBits;
+  if (position >= digits.size()) return false;
+  return (digits[position] >> (index % limbBits)) & 1;
+}
+
+// Magnitude of the lowest count limbs.
+BigInteger BigInteger::lowLimbs(size_t count) const {
+  return fromLimbs(digits.data(), std::min(count, digits.size()));
+}
+
+// Magnitude shifted right by from limbs.
+BigInteger BigInteger::highLimbs(size_t from) const {
+  if (from >= digits.size()) return BigInteger();
+  return fromLimbs(digits.data() + from, digits.size() - from);
+}
+
+void BigInteger::shiftLimbsLeft(size_t count) {
+  if (!isZero()) digits.insert(digits.begin(), count, 0);
+}
+
+void BigInteger::shiftLeft(size_t bits) {
+  shiftLimbsLeft(bits / limbBits);
+  int shift = bits % limbBits;
+  if (shift == 0 or isZero()) return;
+
+  limb carry = 0;
+  for (size_t i = 0; i < digits.size(); ++i) {
+    limb next = digits[i] >> (limbBits - shift);
+    digits[i] = (digits[i] << shift) | carry;
+    carry = next;
+  }
+  if (carry) digits.push_back(carry);
+}
+
+void BigInteger::shiftRight(size_t bits) {
+  size_t count = bits / limbBits;
+  if (count >= digits.size()) {
+    digits.assign(1, 0);
+    sign = 1;
+    return;
+  }
+  digits.erase(digits.begin(), digits.begin() + count);
+
+  int shift = bits % limbBits;
+  if (shift) {
+    for (size_t i = 0; i + 1 < digits.size(); ++i)
+      digits[i] = (digits[i] >> shift) | (digits[i + 1] << (limbBits - shift));
+    digits.back() >>= shift;
+  }
+  removeLeadingZeros();
+  if (isZero()) sign = 1;
+}
+
+void BigInteger::addOne() {
+  for (size_t i = 0; i < digits.size(); ++i) {
+    if (++digits[i] != 0) return;
+  }
+  digits.push_back(1);
+}
+
+void BigInteger::subtractOne() {
+  if (isZero()) {
+    sign = 0;
+    digits[0] = 1;
+  } else {
+    for (size_t i = 0; i < digits.size(); ++i) {
+      if (digits[i]-- != 0) break;
+    }
+  }
+
+  removeLeadingZeros();
+
+  if (isZero()) sign = 1;
+}
+
+// Both kernels size the result once and run a single carry pass over the
+// limbs through addLimbs / subLimbs.
+void BigInteger::addPositive(const BigInteger& right) {
+  size_t n = digits.size(), m = right.digits.size();
+  BIGINT_RECORD(add, n + m);
+  if (digits.capacity() < std::max(n, m) + 1)
+    digits.reserve(std::max(n, m) + 1);
+
+  limb carry;
+  if (n >= m) {
+    carry = addLimbs(digits.data(), digits.data(), n, right.digits.data(), m);
+  } else {
+    digits.resize(m);
+    carry = addLimbs(digits.data(), right.digits.data(), m, digits.data(), n);
+  }
+
+  if (carry) digits.push_back(carry);
+}
+
+void BigInteger::subtractPositive(const BigInteger& right) {
+  BIGINT_RECORD(subtract, digits.size() + right.digits.size());
+  int cmp = compareAbs(right);
+  if (cmp == 0) {
+    digits.assign(1, 0);
+    sign = 1;
+    return;
+  }
+
+  // Always subtract the smaller magnitude from the larger one; if |right| is
+  // the larger one the result changes sign.
+  size_t n = digits.size(), m = right.digits.size();
+  if (cmp > 0) {
+    subLimbs(digits.data(), digits.data(), n, right.digits.data(), m);
+  } else {
+    digits.resize(m);
+    subLimbs(digits.data(), right.digits.data(), m, digits.data(), n);
+    sign ^= 1;
+  }
+
+  removeLeadingZeros();
+}
+
+template <limb mod>
+limb BigInteger::powMod(limb base, limb exp) {
+  dlimb res = 1, cur = base % mod;
+  while (exp) {
+    if (exp & 1) res = res * cur % mod;
+    cur = cur * cur % mod;
+    exp >>= 1;
+  }
+  return static_cast<limb>(res);
+}
+
+// Returns the stage table of len = 2^logLen entries, roots[j] = w^j for the
+// primitive 2len-th root of unity w. Each table is built once, from the one
+// of the previous stage, and never changes afterwards, so concurrent
+// transforms share it without locking.
+template <limb mod, limb root>
+const BigInteger::NttRoots& BigInteger::nttRoots(size_t logLen) {
+  static NttRoots levels[nttMaxLog];
+  static std::once_flag built[nttMaxLog];
+  std::call_once(built[logLen], [logLen] {
+    size_t len = size_t(1) << logLen;
+    NttRoots& level = levels[logLen];
+    BIGINT_RECORD_ALLOCATION(len);  // roots
+    BIGINT_RECORD_ALLOCATION(len);  // quotients
+    level.roots.resize(len);
+    level.quotients.resize(len);
+    level.roots[0] = 1;
+    if (logLen > 0) {
+      const std::vector<limb>& half = nttRoots<mod, root>(logLen - 1).roots;
+      dlimb w = powMod<mod>(root, (mod - 1) / (2 * len));
+      for (size_t j = 0; j < len / 2; ++j) {
+        level.roots[2 * j] = half[j];
+        level.roots[2 * j + 1] = static_cast<limb>(half[j] * w % mod);
+      }
+    }
+    for (size_t j = 0; j < len; ++j)
+      level.quotients[j] = static_cast<limb>(
+          (static_cast<dlimb>(level.roots[j]) << limbBits) / mod);
+  });
+  return levels[logLen];
+}
+
+// Butterflies (x[i], x[len + i]) -> (x[i] + w[i] x[len + i],
+// x[i] - w[i] x[len + i]) for i < count. Shoup's product t * w - q * mod lies
+// in [0, 2 mod), which fits a limb because every NTT prime is below 2^31.
+void BigInteger::butterfliesScalar(limb* x, size_t len, const limb* w,
+                                   const limb* wq, size_t count, limb mod) {
+  limb* y = x + len;
+  for (size_t i = 0; i < count; ++i) {
+    limb u = x[i], t = y[i];
+    limb q = static_cast<limb>((static_cast<dlimb>(t) * wq[i]) >> limbBits);
+    limb v = t * w[i] - q * mod;
+    if (v >= mod) v -= mod;
+    x[i] = u + v >= mod ? u + v - mod : u + v;
+    y[i] = u >= v ? u - v : u + mod - v;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// The vector kernels follow butterfliesScalar lane by lane. The high half of
+// t * wq comes from two 32x32->64 multiplies on the even and odd lanes, and
+// min(r, r - mod) subtracts mod exactly when r >= mod.
+__attribute__((target("avx2"))) void BigInteger::butterfliesAvx2(
+    limb* x, size_t len, const limb* w, const limb* wq, size_t count,
+    limb mod) {
+  limb* y = x + len;
+  const __m256i p = _mm256_set1_epi32(static_cast<int>(mod));
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i u = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+    __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i));
+    __m256i root = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+    __m256i quot = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(wq + i));
+
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(t, quot), 32);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(t, 32),
+                                   _mm256_srli_epi64(quot, 32));
+    __m256i q = _mm256_blend_epi32(even, odd, 0xAA);
+    __m256i v = _mm256_sub_epi32(_mm256_mullo_epi32(t, root),
+                                 _mm256_mullo_epi32(q, p));
+    v = _mm256_min_epu32(v, _mm256_sub_epi32(v, p));
+
+    __m256i sum = _mm256_add_epi32(u, v);
+    sum = _mm256_min_epu32(sum, _mm256_sub_epi32(sum, p));
+    __m256i diff = _mm256_add_epi32(_mm256_sub_epi32(u, v), p);
+    diff = _mm256_min_epu32(diff, _mm256_sub_epi32(diff, p));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(x + i), sum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), diff);
+  }
+  butterfliesScalar(x + i, len, w + i, wq + i, count - i, mod);
+}
+
+// GCC 12 flags the placeholder operands inside its AVX-512 intrinsics.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f"))) void BigInteger::butterfliesAvx512(
+    limb* x, size_t len, const limb* w, const limb* wq, size_t count,
+    limb mod) {
+  limb* y = x + len;
+  const __m512i p = _mm512_set1_epi32(static_cast<int>(mod));
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m512i u = _mm512_loadu_si512(x + i);
+    __m512i t = _mm512_loadu_si512(y + i);
+    __m512i root = _mm512_loadu_si512(w + i);
+    __m512i quot = _mm512_loadu_si512(wq + i);
+
+    __m512i even = _mm512_srli_epi64(_mm512_mul_epu32(t, quot), 32);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(t, 32),
+                                   _mm512_srli_epi64(quot, 32));
+    __m512i q = _mm512_mask_blend_epi32(0xAAAA, even, odd);
+    __m512i v = _mm512_sub_epi32(_mm512_mullo_epi32(t, root),
+                                 _mm512_mullo_epi32(q, p));
+    v = _mm512_min_epu32(v, _mm512_sub_epi32(v, p));
+
+    __m512i sum = _mm512_add_epi32(u, v);
+    sum = _mm512_min_epu32(sum, _mm512_sub_epi32(sum, p));
+    __m512i diff = _mm512_add_epi32(_mm512_sub_epi32(u, v), p);
+    diff = _mm512_min_epu32(diff, _mm512_sub_epi32(diff, p));
+    _mm512_storeu_si512(x + i, sum);
+    _mm512_storeu_si512(y + i, diff);
+  }
+  butterfliesAvx2(x + i, len, w + i, wq + i, count - i, mod);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+// Picks the widest butterfly kernel the CPU supports, once.
+BigInteger::ButterflyKernel BigInteger::butterflyKernel() {
+  static const ButterflyKernel kernel = [] {
+#if (defined(__x86_64__) || defined(__i386__)) && BIGINT_SIMD
+    if (__builtin_cpu_supports("avx512f")) return &butterfliesAvx512;
+    if (__builtin_cpu_supports("avx2")) return &butterfliesAvx2;
+#endif
+    return &butterfliesScalar;
+  }();
+  return kernel;
+}
+
+// Calls body(from, to) on consecutive ranges covering [0, size), spread over
+// the thread pool when parallel is set.
+template <typename Body>
+void BigInteger::forRange(size_t size, bool parallel, Body body) {
+  BigIntegerThreadPool& pool = BigIntegerThreadPool::instance();
+  if (!parallel or pool.threads() == 1) {
+    body(0, size);
+    return;
+  }
+
+  size_t tasks = 4 * pool.threads();
+  pool.run(tasks, [&](size_t t) {
+    body(size * t / tasks, size * (t + 1) / tasks);
+  });
+}
+
+template <limb mod, limb root>
+void BigInteger::ntt(LimbVector& target, bool invert, bool parallel) {
+  size_t tSize = target.size();
+  size_t logSize = __builtin_ctzll(tSize);
+
+  forRange(tSize, parallel, [&](size_t from, size_t to) {
+    if (from >= to) return;
+    size_t j = 0;
+    for (size_t bit = 0; bit < logSize; ++bit)
+      if (from >> bit & 1) j |= tSize >> (bit + 1);
+    for (size_t i = from; i < to; ++i) {
+      if (i < j) std::swap(target[i], target[j]);
+      size_t bit = tSize >> 1;
+      for (; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+    }
+  });
+
+  ButterflyKernel wide = butterflyKernel();
+  for (size_t len = 1, logLen = 0; len < tSize; len *= 2, ++logLen) {
+    // Short stages stay scalar; wider ones have whole vectors per block.
+    ButterflyKernel kernel = len < 8 ? butterfliesScalar : wide;
+    const NttRoots& table = nttRoots<mod, root>(logLen);
+    const limb* roots = table.roots.data();
+    const limb* quotients = table.quotients.data();
+
+    // Butterfly t pairs st + j with st + j + len, where j = t mod len and
+    // st = 2len * (t / len).
+    forRange(tSize / 2, parallel, [&](size_t from, size_t to) {
+      for (size_t t = from; t < to;) {
+        size_t st = t >> logLen << (logLen + 1), j = t & (len - 1);
+        size_t last = std::min(len, j + (to - t));
+        t += last - j;
+        kernel(target.data() + st + j, len, roots + j, quotients + j,
+               last - j, mod);
+      }
+    });
+  }
+
+  if (invert) {
+    // The inverse transform is the forward one with the outputs reversed.
+    std::reverse(target.begin() + 1, target.end());
+    dlimb inv = powMod<mod>(static_cast<limb>(tSize % mod), mod - 2);
+    forRange(tSize, parallel, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i)
+        target[i] = static_cast<limb>(target[i] * inv % mod);
+    });
+  }
+}
+
+// Leaves the cyclic convolution of a and b modulo mod in fa; fb is scratch.
+template <limb mod, limb root>
+void BigInteger::nttConvolve(const limb* a, size_t n, const limb* b, size_t m,
+                             LimbVector& fa, LimbVector& fb, bool parallel) {
+  std::fill(fa.begin(), fa.end(), 0);
+  std::fill(fb.begin(), fb.end(), 0);
+  for (size_t i = 0; i < n; ++i) fa[i] = a[i] % mod;
+
+  ntt<mod, root>(fa, false, parallel);
+  if (a == b and n == m) {
+    // A square needs only one forward transform.
+    forRange(fa.size(), parallel, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i)
+        fa[i] = static_cast<limb>(static_cast<dlimb>(fa[i]) * fa[i] % mod);
+    });
+  } else {
+    for (size_t i = 0; i < m; ++i) fb[i] = b[i] % mod;
+    ntt<mod, root>(fb, false, parallel);
+    forRange(fa.size(), parallel, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; ++i)
+        fa[i] = static_cast<limb>(static_cast<dlimb>(fa[i]) * fb[i] % mod);
+    });
+  }
+  ntt<mod, root>(fa, true, parallel);
+}
+
+// Writes the n + m limbs of a * b to res. Operands longer than half of the
+// largest supported transform are multiplied block by block.
+void BigInteger::nttMultiply(const limb* a, size_t n, const limb* b, size_t m,
+                             limb* res) {
+  const size_t maxBlock = nttMaxSize / 2;
+  const dlimb inv01 = powMod<nttPrime1>(nttPrime0, nttPrime1 - 2);
+  const dlimb inv012 = powMod<nttPrime2>(
+      static_cast<limb>(static_cast<dlimb>(nttPrime0) * nttPrime1 % nttPrime2),
+      nttPrime2 - 2);
+  const dlimb prime01 = static_cast<dlimb>(nttPrime0) * nttPrime1;
+
+  bool parallel = m >= BIGINT_PARALLEL_THRESHOLD;
+
+  std::fill(res, res + n + m, 0);
+  // The transform buffers come from the current LimbAllocator like any
+  // other limb buffer.
+  LimbVector fa, fb, res0, res1;
+
+  for (size_t i = 0; i < n; i += maxBlock) {
+    for (size_t j = 0; j < m; j += maxBlock) {
+      size_t blockN = std::min(maxBlock, n - i);
+      size_t blockM = std::min(maxBlock, m - j);
+      size_t len = blockN + blockM - 1;
+      size_t tSize = 1;
+      while (tSize < len) tSize *= 2;
+      BIGINT_RECORD(ntt, tSize);
+      fa.resize(tSize);
+      fb.resize(tSize);
+
+      nttConvolve<nttPrime0, 3>(a + i, blockN, b + j, blockM, fa, fb,
+                                parallel);
+      res0.assign(fa.begin(), fa.begin() + len);
+      nttConvolve<nttPrime1, 13>(a + i, blockN, b + j, blockM, fa, fb,
+                                 parallel);
+      res1.assign(fa.begin(), fa.begin() + len);
+      nttConvolve<nttPrime2, 31>(a + i, blockN, b + j, blockM, fa, fb,
+                                 parallel);
+
+      // Garner's CRT: x = r0 + p0 * k1 + p0 * p1 * k2, then add x into res.
+      unsigned __int128 carry = 0;
+      limb* out = res + i + j;
+      for (size_t k = 0; k < blockN + blockM; ++k) {
+        if (k < len) {
+          dlimb r0 = res0[k], r1 = res1[k], r2 = fa[k];
+          dlimb k1 = (r1 + nttPrime1 - r0 % nttPrime1) * inv01 % nttPrime1;
+          dlimb x01 = r0 + k1 * nttPrime0;
+          dlimb k2 =
+              (r2 + nttPrime2 - x01 % nttPrime2) * inv012 % nttPrime2;
+          carry += x01 + static_cast<unsigned __int128>(k2) * prime01;
+        }
+        carry += out[k];
+        out[k] = static_cast<limb>(carry);
+        carry >>= limbBits;
+      }
+      for (size_t k = blockN + blockM; carry; ++k) {
+        carry += out[k];
+        out[k] = static_cast<limb>(carry);
+        carry >>= limbBits;
+      }
+    }
+  }
+}
+
+// res = a + b for n >= m, returns the carry out of the n-th limb. res may
+// be a itself.
+limb BigInteger::addLimbs(limb* res, const limb* a, size_t n, const limb* b,
+                          size_t m) {
+  dlimb carry = 0;
+  size_t i = 0;
+  for (; i < m; ++i) {
+    carry += static_cast<dlimb>(a[i]) + b[i];
+    res[i] = static_cast<limb>(carry);
+    carry >>= limbBits;
+  }
+  for (; i < n and carry; ++i) {
+    carry += a[i];
+    res[i] = static_cast<limb>(carry);
+    carry >>= limbBits;
+  }
+  if (res != a) std::copy(a + i, a + n, res + i);
+  return static_cast<limb>(carry);
+}
+
+// res = a - b for n >= m, returns the borrow out of the n-th limb. res may
+// be a itself.
+limb BigInteger::subLimbs(limb* res, const limb* a, size_t n, const limb* b,
+                          size_t m) {
+  limb borrow = 0;
+  size_t i = 0;
+  for (; i < m; ++i) {
+    // The borrow is the top bit of the wrapped-around 64-bit difference.
+    dlimb diff = static_cast<dlimb>(a[i]) - b[i] - borrow;
+    res[i] = static_cast<limb>(diff);
+    borrow = static_cast<limb>(diff >> (2 * limbBits - 1));
+  }
+  for (; i < n and borrow; ++i) {
+    borrow = a[i] == 0;
+    res[i] = a[i] - 1;
+  }
+  if (res != a) std::copy(a + i, a + n, res + i);
+  return borrow;
+}
+
+void BigInteger::mulSchoolbook(const limb* a, size_t n, const limb* b,
+                               size_t m, limb* res) {
+  std::fill(res, res + n + m, 0);
+  for (size_t i = 0; i < m; ++i) {
+    dlimb carry = 0;
+    for (size_t j = 0; j < n; ++j) {
+      carry += static_cast<dlimb>(a[j]) * b[i] + res[i + j];
+      res[i + j] = static_cast<limb>(carry);
+      carry >>= limbBits;
+    }
+    res[i + n] = static_cast<limb>(carry);
+  }
+}
+
+// a^2 from the products a[i] * a[j] with i < j, doubled, plus the diagonal
+// squares: about half the limb products of mulSchoolbook.
+void BigInteger::sqrSchoolbook(const limb* a, size_t n, limb* res) {
+  std::fill(res, res + 2 * n, 0);
+  for (size_t i = 0; i < n; ++i) {
+    dlimb carry = 0;
+    for (size_t j = i + 1; j < n; ++j) {
+      carry += static_cast<dlimb>(a[i]) * a[j] + res[i + j];
+      res[i + j] = static_cast<limb>(carry);
+      carry >>= limbBits;
+    }
+    res[i + n] = static_cast<limb>(carry);
+  }
+
+  limb top = 0;
+  for (size_t i = 0; i < 2 * n; ++i) {
+    limb next = res[i] >> (limbBits - 1);
+    res[i] = (res[i] << 1) | top;
+    top = next;
+  }
+
+  dlimb carry = 0;
+  for (size_t i = 0; i < n; ++i) {
+    dlimb square = static_cast<dlimb>(a[i]) * a[i];
+    carry += res[2 * i] + static_cast<dlimb>(static_cast<limb>(square));
+    res[2 * i] = static_cast<limb>(carry);
+    carry >>= limbBits;
+    carry += res[2 * i + 1] + (square >> limbBits);
+    res[2 * i + 1] = static_cast<limb>(carry);
+    carry >>= limbBits;
+  }
+}
+
+// The recursive kernels recognise a square by a == b and n == m and pass it
+// on to their sub-products, which end in sqrSchoolbook or a single-transform
+// NTT.
+void BigInteger::squareLimbs(const limb* a, size_t n, limb* res) {
+  if (n < BIGINT_KARATSUBA_SQR_THRESHOLD) {
+    sqrSchoolbook(a, n, res);
+  } else if (n >= BIGINT_NTT_THRESHOLD) {
+    nttMultiply(a, n, a, n, res);
+  } else if (n < BIGINT_TOOM3_THRESHOLD) {
+    mulKaratsuba(a, n, a, n, res);
+  } else {
+    mulToom3(a, n, a, n, res);
+  }
+}
+
+// Expects n >= m > n / 2. With a = a1 * B^h + a0 and b = b1 * B^h + b0 the
+// middle product is (a0 + a1)(b0 + b1) - a0 b0 - a1 b1.
+void BigInteger::mulKaratsuba(const limb* a, size_t n, const limb* b,
+                              size_t m, limb* res) {
+  size_t h = (n + 1) / 2;
+  size_t n1 = n - h, m1 = m - h;
+
+  multiplyLimbs(a, h, b, h, res);
+  if (m1) {
+    multiplyLimbs(a + h, n1, b + h, m1, res + 2 * h);
+  } else {
+    std::fill(res + 2 * h, res + n + m, 0);
+  }
+
+  LimbVector sumA, sumB, mid;
+  sumA.resize(h + 1);
+  mid.resize(2 * h + 2);
+  sumA[h] = addLimbs(sumA.data(), a, h, a + h, n1);
+  if (a == b and n == m) {
+    multiplyLimbs(sumA.data(), h + 1, sumA.data(), h + 1, mid.data());
+  } else {
+    sumB.resize(h + 1);
+    sumB[h] = addLimbs(sumB.data(), b, h, b + h, m1);
+    multiplyLimbs(sumA.data(), h + 1, sumB.data(), h + 1, mid.data());
+  }
+  subLimbs(mid.data(), mid.data(), mid.size(), res, 2 * h);
+  subLimbs(mid.data(), mid.data(), mid.size(), res + 2 * h, n1 + m1);
+
+  size_t midLen = mid.size();
+  while (midLen > 0 and !mid[midLen - 1]) --midLen;
+  addLimbs(res + h, res + h, n + m - h, mid.data(), midLen);
+}
+
+// Toom-Cook 3 with evaluation points 0, 1, -1, -2, inf and Bodrato's
+// interpolation sequence. Expects n >= m > n / 2. The evaluations are signed,
+// so they are done on BigInteger values and the point products go back
+// through the dispatcher.
+void BigInteger::mulToom3(const limb* a, size_t n, const limb* b, size_t m,
+                          limb* res) {
+  size_t k = (n + 2) / 3;
+  auto piece = [k](const limb* x, size_t len, size_t idx) {
+    size_t from = std::min(len, idx * k);
+    return fromLimbs(x + from, std::min(len, from + k) - from);
+  };
+  BigInteger a0 = piece(a, n, 0), a1 = piece(a, n, 1), a2 = piece(a, n, 2);
+  BigInteger evenA = a0 + a2;
+  BigInteger valueA1 = evenA + a1;
+  BigInteger valueAm1 = evenA - a1;
+  BigInteger valueAm2 = (valueAm1 + a2) * 2 - a0;
+
+  BigInteger r0, r1, rm1, rm2, rInf;
+  if (a == b and n == m) {
+    // Squaring: operator* sees the same object on both sides.
+    r0 = a0 * a0;
+    r1 = valueA1 * valueA1;
+    rm1 = valueAm1 * valueAm1;
+    rm2 = valueAm2 * valueAm2;
+    rInf = a2 * a2;
+  } else {
+    BigInteger b0 = piece(b, m, 0), b1 = piece(b, m, 1), b2 = piece(b, m, 2);
+    BigInteger evenB = b0 + b2;
+    BigInteger valueB1 = evenB + b1;
+    BigInteger valueBm1 = evenB - b1;
+    BigInteger valueBm2 = (valueBm1 + b2) * 2 - b0;
+
+    r0 = a0 * b0;
+    r1 = valueA1 * valueB1;
+    rm1 = valueAm1 * valueBm1;
+    rm2 = valueAm2 * valueBm2;
+    rInf = a2 * b2;
+  }
+
+  // Exact divisions by small constants keep the sign of the dividend.
+  BigInteger c3 = rm2 - r1;
+  c3.divSmall(3);
+  BigInteger c1 = r1 - rm1;
+  c1.divSmall(2);
+  BigInteger c2 = rm1 - r0;
+  c3 = c2 - c3;
+  c3.divSmall(2);
+  c3 += rInf * 2;
+  c2 += c1;
+  c2 -= rInf;
+  c1 -= c3;
+
+  // All coefficients of the product polynomial are non-negative.
+  std::fill(res, res + n + m, 0);
+  const BigInteger* coefficients[] = {&r0, &c1, &c2, &c3, &rInf};
+  for (size_t i = 0; i < 5; ++i) {
+    const LimbVector& c = coefficients[i]->digits;
+    if (i * k >= n + m) break;
+    size_t len = c.size();
+    while (len > 0 and !c[len - 1]) --len;
+    addLimbs(res + i * k, res + i * k, n + m - i * k, c.data(), len);
+  }
+}
+
+// Picks the multiplication algorithm from the operand sizes. Operands much
+// longer than the other one are cut into slices of the shorter length so that
+// the balanced algorithms always see comparable sizes.
+void BigInteger::multiplyLimbs(const limb* a, size_t n, const limb* b,
+                               size_t m, limb* res) {
+  if (a == b and n == m) {
+    squareLimbs(a, n, res);
+    return;
+  }
+
+  if (n < m) {
+    std::swap(a, b);
+    std::swap(n, m);
+  }
+
+  if (m < BIGINT_KARATSUBA_THRESHOLD) {
+    mulSchoolbook(a, n, b, m, res);
+  } else if (m >= BIGINT_NTT_THRESHOLD) {
+    nttMultiply(a, n, b, m, res);
+  } else if (2 * m <= n) {
+    std::fill(res, res + n + m, 0);
+    LimbVector part;
+    part.resize(2 * m);
+    for (size_t i = 0; i < n; i += m) {
+      size_t len = std::min(m, n - i);
+      multiplyLimbs(a + i, len, b, m, part.data());
+      addLimbs(res + i, res + i, len + m, part.data(), len + m);
+    }
+  } else if (m < BIGINT_TOOM3_THRESHOLD) {
+    mulKaratsuba(a, n, b, m, res);
+  } else {
+    mulToom3(a, n, b, m, res);
+  }
+}
+
+BigInteger BigInteger::fromLimbs(const limb* a, size_t n) {
+  BigInteger res;
+  if (n) res.digits.assign(a, a + n);
+  res.removeLeadingZeros();
+  return res;
+}
+
+// res = a * b. The product is written straight into res unless res is one of
+// the operands, so a reused res keeps its buffer.
+void BigInteger::multiply(const BigInteger& a, const BigInteger& b,
+                          BigInteger& res) {
+  if (a.isZero() or b.isZero()) {
+    res.digits.assign(1, 0);
+    res.sign = 1;
+    return;
+  }
+
+  if (&a == &b) {
+    squareInto(a, res);
+    return;
+  }
+
+  bool productSign = (a.sign == b.sign);
+  size_t n = a.digits.size(), m = b.digits.size();
+  BIGINT_RECORD(multiply, n + m);
+  if (&res == &a or &res == &b) {
+    LimbVector product;
+    product.resize(n + m);
+    multiplyLimbs(a.digits.data(), n, b.digits.data(), m, product.data());
+    res.digits.swap(product);
+  } else {
+    res.digits.assign(n + m, 0);
+    multiplyLimbs(a.digits.data(), n, b.digits.data(), m, res.digits.data());
+  }
+  res.sign = productSign;
+
+  res.removeLeadingZeros();
+}
+
+void BigInteger::addProduct(BigInteger& acc, const BigInteger& a,
+                            const BigInteger& b, bool subtract) {
+  static thread_local BigInteger product = [] {
+    LimbAllocatorScope heap(nullptr);
+    return BigInteger();
+  }();
+  multiply(a, b, product);
+  if (subtract) {
+    acc -= product;
+  } else {
+    acc += product;
+  }
+}
+
+void BigInteger::squareInto(const BigInteger& a, BigInteger& res) {
+  size_t n = a.digits.size();
+  BIGINT_RECORD(square, n);
+  if (&res == &a) {
+    LimbVector product;
+    product.resize(2 * n);
+    squareLimbs(a.digits.data(), n, product.data());
+    res.digits.swap(product);
+  } else {
+    res.digits.assign(2 * n, 0);
+    squareLimbs(a.digits.data(), n, res.digits.data());
+  }
+  res.sign = 1;
+
+  res.removeLeadingZeros();
+}
+
+// Left-to-right sliding-window exponentiation: one square per exponent bit
+// and one multiplication by a precomputed odd power per window. one is the
+// identity of the arithmetic that multiply and square implement.
+template <typename Multiply, typename Square>
+BigInteger BigInteger::windowPow(const BigInteger& base, const BigInteger& exp,
+                                 const BigInteger& one, Multiply multiply,
+                                 Square square) {
+  size_t bits = exp.bitLength();
+  if (bits == 0) return one;
+
+  size_t window = bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4
+                : bits > 23  ? 3 : bits > 6  ? 2 : 1;
+
+  // odd[i] = base^(2i + 1) for the 2^(window - 1) odd powers in use.
+  std::array<BigInteger, 32> odd;
+  size_t oddCount = size_t(1) << (window - 1);
+  odd[0] = base;
+  if (oddCount > 1) {
+    BigInteger baseSquared = square(base);
+    for (size_t i = 1; i < oddCount; ++i)
+      odd[i] = multiply(odd[i - 1], baseSquared);
+  }
+
+  BigInteger res = one;
+  bool started = false;
+  for (size_t i = bits; i > 0;) {
+    if (!exp.testBit(i - 1)) {
+      if (started) res = square(res);
+      --i;
+      continue;
+    }
+
+    size_t low = i > window ? i - window : 0;
+    while (!exp.testBit(low)) ++low;
+
+    size_t value = 0;
+    for (size_t k = i; k > low; --k) {
+      value = 2 * value + exp.testBit(k - 1);
+      if (started) res = square(res);
+    }
+
+    if (started) {
+      res = multiply(res, odd[value / 2]);
+    } else {
+      res = odd[value / 2];
+      started = true;
+    }
+    i = low;
+  }
+
+  return res;
+}
+
+void BigInteger::multOnBigInt(const BigInteger& right) {
+  multiply(*this, right, *this);
+}
+
+void BigInteger::multOnInt(long long right) {
+  unsigned long long magnitude = right;
+  if (right < 0) {
+    magnitude = 0ull - magnitude;
+    sign ^= 1;
+  }
+
+  if (magnitude >> limbBits) {
+    BigInteger factor(right);
+    factor.sign = 1;
+    multOnBigInt(factor);
+  } else {
+    mulSmall(static_cast<limb>(magnitude));
+  }
+
+  if (isZero()) sign = 1;
+}
+
+// |this| = |this| * factor + addend.
+void BigInteger::mulAddSmall(limb factor, limb addend) {
+  dlimb carry = addend;
+  for (size_t i = 0; i < digits.size(); ++i) {
+    carry += static_cast<dlimb>(digits[i]) * factor;
+    digits[i] = static_cast<limb>(carry);
+    carry >>= limbBits;
+  }
+  if (carry) digits.push_back(static_cast<limb>(carry));
+  removeLeadingZeros();
+}
+
+BigInteger& BigInteger::mulSmall(limb factor) {
+  mulAddSmall(factor, 0);
+  if (isZero()) sign = 1;
+  return *this;
+}
+
+BigInteger& BigInteger::addSmall(limb value) {
+  if (sign) {
+    mulAddSmall(1, value);
+  } else if (digits.size() == 1 and digits[0] <= value) {
+    digits[0] = value - digits[0];
+    sign = 1;
+  } else {
+    limb borrow = value;
+    for (size_t i = 0; borrow; ++i) {
+      limb next = digits[i] < borrow;
+      digits[i] -= borrow;
+      borrow = next;
+    }
+    removeLeadingZeros();
+  }
+  return *this;
+}
+
+BigInteger::LimbDivisor::LimbDivisor(limb divisor)
+    : shift(__builtin_clz(divisor)) {
+  normalized = divisor << shift;
+  inverse = static_cast<limb>(
+      ((static_cast<dlimb>(~normalized) << limbBits) | ~limb(0)) / normalized);
+}
+
+// Divides high * B + low by the normalized divisor, which needs high below it.
+limb BigInteger::LimbDivisor::divide(limb high, limb low, limb& rem) const {
+  dlimb estimate = static_cast<dlimb>(inverse) * high +
+                   ((static_cast<dlimb>(high) << limbBits) | low);
+  limb q = static_cast<limb>(estimate >> limbBits) + 1;
+  rem = low - q * normalized;
+  if (rem > static_cast<limb>(estimate)) {
+    --q;
+    rem += normalized;
+  }
+  if (rem >= normalized) {
+    ++q;
+    rem -= normalized;
+  }
+  return q;
+}
+
+// Writes the n quotient limbs of a / d to q (which may be a, or null when
+// only the remainder is wanted) and returns a mod d. The dividend is shifted
+// by d.shift on the fly.
+limb BigInteger::divLimbs(limb* q, const limb* a, size_t n,
+                          const LimbDivisor& d) {
+  int s = d.shift;
+  limb rem = 0, digit;
+  if (s == 0) {
+    for (size_t i = n; i-- > 0;) {
+      digit = d.divide(rem, a[i], rem);
+      if (q) q[i] = digit;
+    }
+    return rem;
+  }
+
+  rem = a[n - 1] >> (limbBits - s);
+  for (size_t i = n - 1; i > 0; --i) {
+    digit = d.divide(rem, a[i] << s | a[i - 1] >> (limbBits - s), rem);
+    if (q) q[i] = digit;
+  }
+  digit = d.divide(rem, a[0] << s, rem);
+  if (q) q[0] = digit;
+  return rem >> s;
+}
+
+limb BigInteger::divSmall(const LimbDivisor& divisor) {
+  limb rem = divLimbs(digits.data(), digits.data(), digits.size(), divisor);
+  removeLeadingZeros();
+  if (isZero()) sign = 1;
+  return rem;
+}
+
+limb BigInteger::divSmall(limb divisor) {
+  if (divisor == 0) __builtin_trap();
+  return divSmall(LimbDivisor(divisor));
+}
+
+limb BigInteger::modSmall(limb divisor) const {
+  if (divisor == 0) __builtin_trap();
+  return divLimbs(nullptr, digits.data(), digits.size(), LimbDivisor(divisor));
+}
+
+// Knuth's algorithm D: every quotient limb is estimated from the top two
+// limbs of the remainder and the top limb of the normalized divisor, and is
+// off by at most one after the correction loop.
+void BigInteger::divSchoolbook(const BigInteger& a, const BigInteger& b,
+                               BigInteger& q, BigInteger& r) {
+  if (a.compareAbs(b) < 0) {
+    q = BigInteger();
+    r = a.abs();
+    return;
+  }
+  if (b.digits.size() == 1) {
+    q = a.abs();
+    r = BigInteger(q.divSmall(b.digits[0]));
+    return;
+  }
+
+  size_t n = a.digits.size(), m = b.digits.size();
+  int s = __builtin_clz(b.digits.back());
+  LimbVector vn, un;
+  vn.resize(m);
+  un.resize(n + 1);
+  for (size_t i = m - 1; i > 0; --i)
+    vn[i] = (b.digits[i] << s) |
+            (s ? b.digits[i - 1] >> (limbBits - s) : 0);
+  vn[0] = b.digits[0] << s;
+  un[n] = s ? a.digits[n - 1] >> (limbBits - s) : 0;
+  for (size_t i = n - 1; i > 0; --i)
+    un[i] = (a.digits[i] << s) |
+            (s ? a.digits[i - 1] >> (limbBits - s) : 0);
+  un[0] = a.digits[0] << s;
+
+  q.sign = 1;
+  q.digits.assign(n - m + 1, 0);
+  for (size_t j = n - m + 1; j-- > 0;) {
+    dlimb num = (static_cast<dlimb>(un[j + m]) << limbBits) | un[j + m - 1];
+    dlimb qhat = num / vn[m - 1], rhat = num % vn[m - 1];
+    while ((qhat >> limbBits) or
+           qhat * vn[m - 2] > ((rhat << limbBits) | un[j + m - 2])) {
+      --qhat;
+      rhat += vn[m - 1];
+      if (rhat >> limbBits) break;
+    }
+
+    int64_t borrow = 0, t = 0;
+    for (size_t i = 0; i < m; ++i) {
+      dlimb p = qhat * vn[i];
+      t = static_cast<int64_t>(un[i + j]) - borrow -
+          static_cast<int64_t>(p & 0xffffffffu);
+      un[i + j] = static_cast<limb>(t);
+      borrow = static_cast<int64_t>(p >> limbBits) - (t >> limbBits);
+    }
+    t = static_cast<int64_t>(un[j + m]) - borrow;
+    un[j + m] = static_cast<limb>(t);
+
+    q.digits[j] = static_cast<limb>(qhat);
+    if (t < 0) {
+      --q.digits[j];
+      dlimb carry = 0;
+      for (size_t i = 0; i < m; ++i) {
+        carry += static_cast<dlimb>(un[i + j]) + vn[i];
+        un[i + j] = static_cast<limb>(carry);
+        carry >>= limbBits;
+      }
+      un[j + m] += static_cast<limb>(carry);
+    }
+  }
+  q.removeLeadingZeros();
+
+  r.sign = 1;
+  r.digits.resize(m);
+  for (size_t i = 0; i < m; ++i)
+    r.digits[i] = (un[i] >> s) | (s ? un[i + 1] << (limbBits - s) : 0);
+  r.removeLeadingZeros();
+}
+
+// Burnikel-Ziegler recursive division of a < b * B^n by a normalized n-limb
+// b. Halves that are odd or short fall back to schoolbook division.
+void BigInteger::divTwoByOne(const BigInteger& a, const BigInteger& b,
+                             size_t n, BigInteger& q, BigInteger& r,
+                             size_t cutoff) {
+  if (n % 2 or n < cutoff) {
+    divSchoolbook(a, b, q, r);
+    return;
+  }
+
+  size_t half = n / 2;
+  BigInteger q1, q2, r1;
+  divThreeByTwo(a.highLimbs(half), b, half, q1, r1, cutoff);
+  r1.shiftLimbsLeft(half);
+  r1 += a.lowLimbs(half);
+  divThreeByTwo(r1, b, half, q2, r, cutoff);
 
-  while (digits.size() > 1 and digits.back() == 0) digits.pop_back();
+  q1.shiftLimbsLeft(half);
+  q = q1 + q2;
+}
+
+// Divides a < b * B^half by the 2 * half limbs of b, estimating the quotient
+// from the top halves of both.
+void BigInteger::divThreeByTwo(const BigInteger& a, const BigInteger& b,
+                               size_t half, BigInteger& q, BigInteger& r,
+                               size_t cutoff) {
+  BigInteger topB = b.highLimbs(half);
+  BigInteger r1;
+  if (a.highLimbs(2 * half).compareAbs(topB) < 0) {
+    divTwoByOne(a.highLimbs(half), topB, half, q, r1, cutoff);
+  } else {
+    // The quotient estimate saturates at B^half - 1.
+    q.sign = 1;
+    q.digits.assign(half, ~limb(0));
+    r1 = a.highLimbs(half) + topB;
+    topB.shiftLimbsLeft(half);
+    r1 -= topB;
+  }
+
+  r1.shiftLimbsLeft(half);
+  r1 += a.lowLimbs(half);
+  r1 -= q * b.lowLimbs(half);
+  while (!r1.sign) {
+    --q;
+    r1 += b;
+  }
+  r = r1;
+}
+
+// Scales b to a normalized block length the recursion can halve down to the
+// schoolbook size, then divides a block of two divisor lengths at a time.
+void BigInteger::divBurnikelZiegler(const BigInteger& a, const BigInteger& b,
+                                    BigInteger& q, BigInteger& r,
+                                    size_t cutoff) {
+  size_t m = b.digits.size();
+  size_t levels = 0;
+  while ((m >> levels) >= cutoff) ++levels;
+  size_t n = ((m + (size_t(1) << levels) - 1) >> levels) << levels;
+
+  size_t shift = n * limbBits - b.bitLength();
+  BigInteger bs = b.abs(), as = a.abs();
+  bs.shiftLeft(shift);
+  as.shiftLeft(shift);
+
+  size_t blocks = std::max<size_t>(2, (as.bitLength() + n * limbBits) /
+                                          (n * limbBits));
+  BigInteger z = as.highLimbs((blocks - 2) * n), qi, ri;
+
+  q.sign = 1;
+  q.digits.assign((blocks - 1) * n, 0);
+  for (size_t i = blocks - 1; i-- > 0;) {
+    divTwoByOne(z, bs, n, qi, ri, cutoff);
+    std::copy(qi.digits.begin(), qi.digits.end(), q.digits.begin() + i * n);
+    if (i > 0) {
+      ri.shiftLimbsLeft(n);
+      ri += as.highLimbs((i - 1) * n).lowLimbs(n);
+      z = ri;
+    }
+  }
+  q.removeLeadingZeros();
+  ri.shiftRight(shift);
+  r = ri;
+}
+
+// Approximates B^(2k) / b for a normalized k-limb b by Newton iteration
+// x' = x + x * (B^(2k) - b * x) / B^(2k), seeded with the reciprocal of the
+// top half of b. The result is within a few units of the exact value. Below
+// cutoff limbs the reciprocal comes from one exact division.
+BigInteger BigInteger::reciprocal(const BigInteger& b, size_t cutoff) {
+  size_t k = b.digits.size();
+  if (k < cutoff) {
+    BigInteger power = 1, q, r;
+    power.shiftLimbsLeft(2 * k);
+    if (k < BIGINT_BZ_THRESHOLD)
+      divSchoolbook(power, b, q, r);
+    else
+      divBurnikelZiegler(power, b, q, r);
+    return q;
+  }
+
+  size_t h = k / 2 + 1;
+  BigInteger x = reciprocal(b.highLimbs(k - h), cutoff);
+  x.shiftLimbsLeft(k - h);
+
+  BigInteger error = 1;
+  error.shiftLimbsLeft(2 * k);
+  error -= b * x;
+  BigInteger step = x * error;
+  bool negative = !step.sign;
+  step = step.highLimbs(2 * k);
+  if (negative) step.sign = step.isZero();
+  return x + step;
+}
+
+// Division by a large divisor through multiplication by its reciprocal,
+// two divisor lengths of the dividend at a time.
+void BigInteger::divNewton(const BigInteger& a, const BigInteger& b,
+                           BigInteger& q, BigInteger& r, size_t cutoff) {
+  size_t k = b.digits.size();
+  size_t shift = k * limbBits - b.bitLength();
+  BigInteger bs = b.abs(), as = a.abs();
+  bs.shiftLeft(shift);
+  as.shiftLeft(shift);
+  BigInteger inverse = reciprocal(bs, cutoff);
+
+  size_t blocks = std::max<size_t>(2, (as.bitLength() + k * limbBits) /
+                                          (k * limbBits));
+  BigInteger z = as.highLimbs((blocks - 2) * k), qi, ri, dq, dr;
+
+  q.sign = 1;
+  q.digits.assign((blocks - 1) * k, 0);
+  for (size_t i = blocks - 1; i-- > 0;) {
+    qi = (z * inverse).highLimbs(2 * k);
+    ri = z - qi * bs;
+
+    // The reciprocal is approximate, so fix up the estimate with a short
+    // schoolbook division of the (small) excess or deficit.
+    if (!ri.sign) {
+      divSchoolbook(ri, bs, dq, dr);
+      qi -= dq;
+      ri = -dr;
+      if (!ri.sign) {
+        --qi;
+        ri += bs;
+      }
+    } else if (ri.compareAbs(bs) >= 0) {
+      divSchoolbook(ri, bs, dq, dr);
+      qi += dq;
+      ri = dr;
+    }
+
+    std::copy(qi.digits.begin(), qi.digits.end(), q.digits.begin() + i * k);
+    if (i > 0) {
+      ri.shiftLimbsLeft(k);
+      ri += as.highLimbs((i - 1) * k).lowLimbs(k);
+      z = ri;
+    }
+  }
+  q.removeLeadingZeros();
+  ri.shiftRight(shift);
+  r = ri;
+}
+
+void BigInteger::divModAbs(const BigInteger& right, BigInteger& q,
+                           BigInteger& r) const {
+  size_t m = right.digits.size();
+  BIGINT_RECORD(divide, digits.size() + m);
+  if (compareAbs(right) < 0 or m < BIGINT_BZ_THRESHOLD) {
+    divSchoolbook(*this, right, q, r);
+  } else if (m < BIGINT_NEWTON_THRESHOLD) {
+    divBurnikelZiegler(*this, right, q, r);
+  } else {
+    divNewton(*this, right, q, r);
+  }
+}
+
+void BigInteger::devide(const BigInteger& right,
+                        bool mode) {  // 0 is remainder, 1 is quotient
+  std::pair<BigInteger, BigInteger> res = divmod(*this, right);
+
+  if (mode)
+    *this = std::move(res.first);
+  else
+    *this = std::move(res.second);
+}
+
+// Returns 10^(9 * 2^level). Each power is computed once, by squaring the one
+// below it, under std::call_once and kept for later conversions, so threads
+// converting at the same time share the table without further locking.
+const BigInteger& BigInteger::decimalPower(size_t level) {
+  LimbAllocatorScope heap(nullptr);
+  static BigInteger powers[64];
+  static std::once_flag built[64];
+  std::call_once(built[level], [level] {
+    powers[level] = level == 0 ? BigInteger(decimalBase)
+                               : decimalPower(level - 1).square();
+  });
+  return powers[level];
+}
+
+void BigInteger::emit(std::string& out, const char* text, size_t len) {
+  out.append(text, len);
+}
+
+void BigInteger::emit(std::ostream& out, const char* text, size_t len) {
+  out.write(text, len);
+}
+
+// Appends the decimal digits of |x| to out, left-padded with zeros to width
+// digits (no padding for width 0). Long numbers are split by the cached power
+// of ten closest to their square root and both halves written recursively,
+// high half first, so digits are produced strictly left to right.
+template <typename Sink>
+void BigInteger::writeDecimal(const BigInteger& x, size_t width, Sink& out) {
+  static const char zeros[] = "000000000";
+
+  if (x.digits.size() < BIGINT_RADIX_THRESHOLD) {
+    static const LimbDivisor base(decimalBase);
+    BigInteger rest = x.abs();
+    LimbVector chunks;
+    do {
+      chunks.push_back(rest.divSmall(base));
+    } while (!rest.isZero());
+
+    char buffer[decimalBaseDigits];
+    size_t topLen = 0;
+    for (limb top = chunks.back(); top or !topLen; top /= 10) ++topLen;
+    size_t len = topLen + (chunks.size() - 1) * decimalBaseDigits;
+    for (; width > len; width -= std::min(width - len, sizeof(zeros) - 1))
+      emit(out, zeros, std::min(width - len, sizeof(zeros) - 1));
+
+    for (size_t i = chunks.size(); i-- > 0;) {
+      size_t chunkLen = i + 1 == chunks.size() ? topLen : decimalBaseDigits;
+      for (size_t j = chunkLen; j-- > 0; chunks[i] /= 10)
+        buffer[j] = '0' + chunks[i] % 10;
+      emit(out, buffer, chunkLen);
+    }
+    return;
+  }
+
+  size_t level = 0;
+  while (decimalPower(level + 1).digits.size() * 2 <= x.digits.size()) ++level;
+
+  std::pair<BigInteger, BigInteger> parts = divmod(x.abs(), decimalPower(level));
+  size_t lowWidth = size_t(decimalBaseDigits) << level;
+  writeDecimal(parts.first, width > lowWidth ? width - lowWidth : 0, out);
+  writeDecimal(parts.second, lowWidth, out);
+}
+
+// Parses a string of decimal digits. Long strings are split so that the low
+// part is a cached power-of-ten width and the halves are combined with one
+// multiplication.
+BigInteger BigInteger::parseDecimal(const char* text, size_t len) {
+  if (len <= BIGINT_RADIX_THRESHOLD * decimalBaseDigits) {
+    BigInteger res;
+    size_t chunkLen = len % decimalBaseDigits;
+    if (chunkLen == 0) chunkLen = decimalBaseDigits;
+    for (size_t i = 0; i < len; i += chunkLen) {
+      if (i != 0) chunkLen = decimalBaseDigits;
+      limb chunk = 0, scale = 1;
+      for (size_t j = i; j < i + chunkLen; ++j) {
+        chunk = chunk * 10 + (text[j] - '0');
+        scale *= 10;
+      }
+      res.mulAddSmall(scale, chunk);
+    }
+    return res;
+  }
+
+  size_t level = 0;
+  while ((size_t(decimalBaseDigits) << (level + 1)) < len) ++level;
+  size_t lowWidth = size_t(decimalBaseDigits) << level;
+
+  BigInteger res = parseDecimal(text, len - lowWidth);
+  res *= decimalPower(level);
+  res += parseDecimal(text + len - lowWidth, lowWidth);
+  return res;
+}
+
+std::string BigInteger::toString() const {
+  std::string result;
+  // log10(2) < 0.30103, so this reserves room for every digit.
+  result.reserve(bitLength() * 30103 / 100000 + 2);
+  if (!sign) result += '-';
+  writeDecimal(*this, 0, result);
+  return result;
+}
+
+bool BigInteger::less(const BigInteger& right) const {
+  return compare(right) < 0;
+}
+
+int BigInteger::compare(const BigInteger& right) const {
+  if (sign != right.sign) return sign ? 1 : -1;
+  int cmp = compareAbs(right);
+  return sign ? cmp : -cmp;
+}
+
+bool BigInteger::equal(const BigInteger& right) const {
+  if (sign != right.sign or digits.size() != right.digits.size()) return false;
+  for (size_t i = 0; i < digits.size(); ++i)
+    if (digits[i] != right.digits[i]) return false;
+  return true;
+}
+
+BigInteger BigInteger::abs() const {
+  BigInteger result = (*this);
+  result.sign = 1;
+  return result;
+}
+
+void BigInteger::setThreadCount(size_t count) {
+  BigIntegerThreadPool::instance().setThreads(std::max<size_t>(count, 1));
+}
+
+size_t BigInteger::threadCount() {
+  return BigIntegerThreadPool::instance().threads();
+}
+
+BigInteger BigInteger::square() const {
+  BigInteger res;
+  squareInto(*this, res);
+  return res;
+}
+
+BigInteger BigInteger::operator-() {
+  BigInteger res = (*this);
+  if (!isZero()) res.sign ^= 1;
+  return res;
+}
+
+BigInteger& BigInteger::operator++() {
+  if (sign) {
+    addOne();
+  } else {
+    subtractOne();
+  }
+  return *this;
+}
+
+BigInteger BigInteger::operator++(int) {
+  BigInteger res = *this;
+  ++(*this);
+  return res;
+}
+
+BigInteger& BigInteger::operator--() {
+  if (sign) {
+    subtractOne();
+  } else {
+    addOne();
+  }
+  return *this;
+}
+
+BigInteger BigInteger::operator--(int) {
+  BigInteger res = *this;
+  --(*this);
+  return res;
+}
+
+BigInteger& BigInteger::operator+=(const BigInteger& right) {
+  if (sign) {
+    if (right.sign)
+      addPositive(right);
+    else
+      subtractPositive(right);
+  } else {
+    if (right.sign)
+      subtractPositive(right);
+    else
+      addPositive(right);
+  }
+  return *this;
+}
+
+BigInteger& BigInteger::operator-=(const BigInteger& right) {
+  if (sign) {
+    if (right.sign)
+      subtractPositive(right);
+    else
+      addPositive(right);
+  } else {
+    if (right.sign)
+      addPositive(right);
+    else
+      subtractPositive(right);
+  }
+  return *this;
+}
+
+BigInteger& BigInteger::operator*=(const BigInteger& right) {
+  multOnBigInt(right);
+  return *this;
+}
+
+BigInteger& BigInteger::operator*=(long long right) {
+  multOnInt(right);
+  return *this;
+}
+
+BigInteger& BigInteger::operator/=(const BigInteger& right) {
+  devide(right, 1);
+  return *this;
+}
+
+BigInteger& BigInteger::operator%=(const BigInteger& right) {
+  devide(right, 0);
+  return *this;
+}
+
+BigInteger BigInteger::operator~() const {
+  BigInteger res = *this;
+  if (sign) {
+    res.addOne();
+    res.sign = 0;
+  } else {
+    res.subtractOne();
+    res.sign = 1;
+  }
+  return res;
+}
+
+// Negative operands are complemented limb by limb on the fly (~x + 1 with a
+// running carry), combined, and a negative result is converted back the same
+// way. One spare limb holds the sign extension of both operands.
+template <typename Op>
+void BigInteger::bitwise(const BigInteger& right, Op op) {
+  size_t m = right.digits.size();
+  size_t n = std::max(digits.size(), m) + 1;
+  bool leftNegative = !sign, rightNegative = !right.sign;
+  bool negative = op(limb(leftNegative), limb(rightNegative)) & 1;
+  digits.resize(n, 0);
+
+  limb leftCarry = 1, rightCarry = 1, carry = 1;
+  for (size_t i = 0; i < n; ++i) {
+    limb a = digits[i];
+    if (leftNegative) {
+      a = ~a + leftCarry;
+      leftCarry &= a == 0;
+    }
+    limb b = i < m ? right.digits[i] : 0;
+    if (rightNegative) {
+      b = ~b + rightCarry;
+      rightCarry &= b == 0;
+    }
+    limb r = op(a, b);
+    if (negative) {
+      r = ~r + carry;
+      carry &= r == 0;
+    }
+    digits[i] = r;
+  }
 
+  sign = !negative;
+  removeLeadingZeros();
   if (isZero()) sign = 1;
 }
 
-int BigInteger::reverseBits(int idx, int lg) {
-  int res = 0;
-  for (int i = 0; i < lg; ++i) {
-    if (idx & (1 << i)) res |= (1 << (lg - i - 1));
-  }
+BigInteger& BigInteger::operator&=(const BigInteger& right) {
+  bitwise(right, std::bit_and<limb>());
+  return *this;
+}
+
+BigInteger& BigInteger::operator|=(const BigInteger& right) {
+  bitwise(right, std::bit_or<limb>());
+  return *this;
+}
+
+BigInteger& BigInteger::operator^=(const BigInteger& right) {
+  bitwise(right, std::bit_xor<limb>());
+  return *this;
+}
+
+BigInteger& BigInteger::operator<<=(size_t bits) {
+  shiftLeft(bits);
+  return *this;
+}
+
+// Floor semantics: a negative value that loses set bits moves one further
+// from zero, so -1 >> k stays -1.
+BigInteger& BigInteger::operator>>=(size_t bits) {
+  bool negative = !sign;
+  bool inexact = negative and trailingZeros() < bits;
+  shiftRight(bits);
+  if (negative) {
+    if (inexact) addOne();
+    if (!isZero()) sign = 0;
+  }
+  return *this;
+}
+
+BigInteger::operator bool() const { return !isZero(); }
+
+// The 64 bits of the magnitude starting at bit shift.
+uint64_t BigInteger::bitsFrom(size_t shift) const {
+  size_t idx = shift / limbBits;
+  unsigned __int128 window = 0;
+  for (size_t k = 0; k < 3 and idx + k < digits.size(); ++k)
+    window |= static_cast<unsigned __int128>(digits[idx + k]) << (limbBits * k);
+  return static_cast<uint64_t>(window >> (shift % limbBits));
+}
+
+uint64_t BigInteger::binaryGcd(uint64_t a, uint64_t b) {
+  if (!a or !b) return a | b;
+  int shift = __builtin_ctzll(a | b);
+  a >>= __builtin_ctzll(a);
+  do {
+    b >>= __builtin_ctzll(b);
+    if (a > b) std::swap(a, b);
+    b -= a;
+  } while (b);
+  return a << shift;
+}
+
+// Runs Euclid on the leading 60 bits of x >= y for as long as both quotient
+// bounds agree, so every simulated quotient is also the true one. Returns
+// false when no step could be simulated; otherwise (x, y) maps to
+// (c0 x + c1 y, c2 x + c3 y).
+bool BigInteger::lehmerCofactors(const BigInteger& x, const BigInteger& y,
+                                 int64_t cofactors[4]) {
+  size_t bits = x.bitLength();
+  size_t shift = bits > 60 ? bits - 60 : 0;
+  int64_t u = x.bitsFrom(shift), v = y.bitsFrom(shift);
+  int64_t a = 1, b = 0, c = 0, d = 1;
+
+  while (v + c > 0 and v + d > 0 and u + a >= 0 and u + b >= 0) {
+    int64_t q = (u + a) / (v + c);
+    if (q != (u + b) / (v + d)) break;
+    int64_t t = a - q * c;
+    a = c;
+    c = t;
+    t = b - q * d;
+    b = d;
+    d = t;
+    t = u - q * v;
+    u = v;
+    v = t;
+  }
+
+  cofactors[0] = a;
+  cofactors[1] = b;
+  cofactors[2] = c;
+  cofactors[3] = d;
+  return b != 0;
+}
+
+// Replaces (x, y) by (c0 x + c1 y, c2 x + c3 y) in one pass over the limbs.
+void BigInteger::applyCofactors(BigInteger& x, BigInteger& y,
+                                const int64_t cofactors[4]) {
+  size_t n = x.digits.size();
+  y.digits.resize(n);
+
+  __int128 carryX = 0, carryY = 0;
+  for (size_t i = 0; i < n; ++i) {
+    __int128 xi = x.digits[i], yi = y.digits[i];
+    carryX += cofactors[0] * xi + cofactors[1] * yi;
+    carryY += cofactors[2] * xi + cofactors[3] * yi;
+    x.digits[i] = static_cast<limb>(carryX);
+    y.digits[i] = static_cast<limb>(carryY);
+    carryX >>= limbBits;
+    carryY >>= limbBits;
+  }
+
+  x.removeLeadingZeros();
+  y.removeLeadingZeros();
+}
+
+// Half-gcd: reduces a >= b until b has at most half the bits a started with,
+// recursing on the leading parts of long operands. When matrix is given it
+// receives the unimodular m with (a', b') = m (a, b). A matrix taken from the
+// leading parts can be slightly off for the full numbers, so signs and order
+// are repaired after applying it and a plain division step is used whenever
+// it fails to make progress.
+void BigInteger::hgcdReduce(BigInteger& a, BigInteger& b, BigInteger* matrix) {
+  if (matrix) {
+    matrix[0] = matrix[3] = 1;
+    matrix[1] = matrix[2] = 0;
+  }
+
+  size_t target = a.bitLength() / 2;
+  int64_t cofactors[4];
+  while (!b.isZero() and b.bitLength() > target) {
+    size_t bits = a.bitLength();
+    size_t shift = std::max(2 * target > bits ? 2 * target - bits : 0,
+                            bits / 2) / limbBits;
+
+    if (shift > 0 and
+        a.digits.size() - shift >= BIGINT_HGCD_BASE_THRESHOLD) {
+      BigInteger topA = a.highLimbs(shift), topB = b.highLimbs(shift), sub[4];
+      hgcdReduce(topA, topB, sub);
+
+      BigInteger nextA = sub[0] * a + sub[1] * b;
+      BigInteger nextB = sub[2] * a + sub[3] * b;
+      if (!nextA.sign) {
+        nextA = -nextA;
+        sub[0] = -sub[0];
+        sub[1] = -sub[1];
+      }
+      if (!nextB.sign) {
+        nextB = -nextB;
+        sub[2] = -sub[2];
+        sub[3] = -sub[3];
+      }
+      if (nextA < nextB) {
+        std::swap(nextA, nextB);
+        std::swap(sub[0], sub[2]);
+        std::swap(sub[1], sub[3]);
+      }
+
+      if (nextA < a) {
+        a = std::move(nextA);
+        b = std::move(nextB);
+        if (matrix) {
+          BigInteger m0 = sub[0] * matrix[0] + sub[1] * matrix[2];
+          BigInteger m1 = sub[0] * matrix[1] + sub[1] * matrix[3];
+          BigInteger m2 = sub[2] * matrix[0] + sub[3] * matrix[2];
+          BigInteger m3 = sub[2] * matrix[1] + sub[3] * matrix[3];
+          matrix[0] = std::move(m0);
+          matrix[1] = std::move(m1);
+          matrix[2] = std::move(m2);
+          matrix[3] = std::move(m3);
+        }
+        continue;
+      }
+    } else if (lehmerCofactors(a, b, cofactors)) {
+      applyCofactors(a, b, cofactors);
+      if (matrix) {
+        for (size_t j = 0; j < 2; ++j) {
+          BigInteger top = matrix[j], bottom = matrix[2 + j];
+          BigInteger part = bottom;
+          matrix[j] *= cofactors[0];
+          part *= cofactors[1];
+          matrix[j] += part;
+          matrix[2 + j] *= cofactors[3];
+          top *= cofactors[2];
+          matrix[2 + j] += top;
+        }
+      }
+      continue;
+    }
+
+    std::pair<BigInteger, BigInteger> division = divmod(a, b);
+    a = std::move(b);
+    b = std::move(division.second);
+    if (matrix) {
+      for (size_t j = 0; j < 2; ++j) {
+        BigInteger next = matrix[j] - division.first * matrix[2 + j];
+        matrix[j] = std::move(matrix[2 + j]);
+        matrix[2 + j] = std::move(next);
+      }
+    }
+  }
+}
+
+// Greatest common divisor of |left| and |right|: half-gcd reduction for long
+// operands, Lehmer steps with word-sized cofactors below that, and binary gcd
+// once both fit in a machine word.
+BigInteger gcd(const BigInteger& left, const BigInteger& right) {
+  BigInteger x = left.abs(), y = right.abs();
+  if (x < y) std::swap(x, y);
+
+  int64_t cofactors[4];
+  while (!y.isZero()) {
+    if (x.digits.size() <= 2) {
+      uint64_t g = BigInteger::binaryGcd(x.bitsFrom(0), y.bitsFrom(0));
+      limb words[] = {static_cast<limb>(g), static_cast<limb>(g >> 32)};
+      return BigInteger::fromLimbs(words, 2);
+    }
+
+    if (y.digits.size() >= BIGINT_HGCD_THRESHOLD and
+        2 * y.bitLength() > x.bitLength()) {
+      BigInteger::hgcdReduce(x, y, nullptr);
+    } else if (BigInteger::lehmerCofactors(x, y, cofactors)) {
+      BigInteger::applyCofactors(x, y, cofactors);
+    } else {
+      x %= y;
+      std::swap(x, y);
+    }
+  }
+
+  return x;
+}
+
+// base^exp.
+BigInteger pow(const BigInteger& base, uint64_t exp) {
+  limb words[] = {static_cast<limb>(exp), static_cast<limb>(exp >> 32)};
+  BigInteger power = BigInteger::fromLimbs(words, 2);
+
+  return BigInteger::windowPow(
+      base, power, BigInteger(1),
+      [](const BigInteger& a, const BigInteger& b) { return a * b; },
+      [](const BigInteger& a) { return a.square(); });
+}
+
+// Precomputed data for arithmetic modulo one positive modulus m of k limbs.
+// Products are reduced with Barrett's method using mu = B^(2k) / m, and pow
+// works in Montgomery form (R = B^k) when m is odd. Build one context per
+// modulus and reuse it across calls. A zero modulus or a negative exponent
+// stops the program, as division by zero does.
+class ModularContext {
+ private:
+  BigInteger mod, mu;
+  size_t size;
+  bool montgomery;
+  limb inverse;               // -m^-1 mod B, for Montgomery reduction
+  BigInteger one, rSquared;   // R mod m and R^2 mod m
+
+  BigInteger barrett(const BigInteger& x) const;
+  BigInteger redc(const BigInteger& t) const;
+
+ public:
+  explicit ModularContext(const BigInteger& modulus);
+
+  const BigInteger& modulus() const { return mod; }
+
+  BigInteger reduce(const BigInteger& a) const;
+  BigInteger multiply(const BigInteger& a, const BigInteger& b) const;
+  BigInteger pow(const BigInteger& base, const BigInteger& exp) const;
+};
+
+ModularContext::ModularContext(const BigInteger& modulus)
+    : mod(modulus.abs()), size(mod.digits.size()), inverse(0) {
+  if (mod.isZero()) __builtin_trap();
+  BigInteger power = 1;
+  power.shiftLimbsLeft(2 * size);
+  mu = power / mod;
+
+  montgomery = mod.digits[0] & 1;
+  if (montgomery) {
+    // Newton's iteration for m^-1 mod 2^32 doubles the correct low bits,
+    // starting from 3 since m * m = 1 mod 8 for odd m.
+    limb x = mod.digits[0];
+    for (int i = 0; i < 4; ++i) x *= 2 - mod.digits[0] * x;
+    inverse = 0 - x;
+
+    one = 1;
+    one.shiftLimbsLeft(size);
+    one %= mod;
+    rSquared = power % mod;
+  }
+}
+
+// x mod m for 0 <= x < B^(2k). The quotient estimate is at most two short.
+BigInteger ModularContext::barrett(const BigInteger& x) const {
+  BigInteger estimate = x.highLimbs(size - 1) * mu;
+  BigInteger r = x - estimate.highLimbs(size + 1) * mod;
+  while (r.compareAbs(mod) >= 0) r.subtractPositive(mod);
+  return r;
+}
+
+// t * R^-1 mod m for 0 <= t < m * R.
+BigInteger ModularContext::redc(const BigInteger& t) const {
+  LimbVector work;
+  work.assign(2 * size + 1, 0);
+  std::copy(t.digits.begin(), t.digits.end(), work.begin());
+
+  const limb* m = mod.digits.data();
+  for (size_t i = 0; i < size; ++i) {
+    limb u = work[i] * inverse;
+    dlimb carry = 0;
+    for (size_t j = 0; j < size; ++j) {
+      carry += static_cast<dlimb>(u) * m[j] + work[i + j];
+      work[i + j] = static_cast<limb>(carry);
+      carry >>= BigInteger::limbBits;
+    }
+    for (size_t j = i + size; carry; ++j) {
+      carry += work[j];
+      work[j] = static_cast<limb>(carry);
+      carry >>= BigInteger::limbBits;
+    }
+  }
+
+  BigInteger res = BigInteger::fromLimbs(work.data() + size, size + 1);
+  if (res.compareAbs(mod) >= 0) res.subtractPositive(mod);
+  return res;
+}
+
+// a mod m in [0, m).
+BigInteger ModularContext::reduce(const BigInteger& a) const {
+  BigInteger res = a.abs();
+  res = res.digits.size() <= 2 * size ? barrett(res) : res % mod;
+  if (!a.sign and !res.isZero()) res = mod - res;
   return res;
 }
 
-int BigInteger::lgBase() {
-  int ans = 1;
-  while (ans < base) {
-    ans *= 10;
-  }
-  return ans;
+BigInteger ModularContext::multiply(const BigInteger& a,
+                                    const BigInteger& b) const {
+  return barrett(reduce(a) * reduce(b));
 }
 
-void BigInteger::fft(std::vector<comp>& target, bool invert) {
-  double PI = acos(-1.0);
+// base^exp mod m for exp >= 0.
+BigInteger ModularContext::pow(const BigInteger& base,
+                               const BigInteger& exp) const {
+  if (!exp.sign) __builtin_trap();
+  if (!montgomery) {
+    return BigInteger::windowPow(
+        reduce(base), exp, reduce(1),
+        [this](const BigInteger& a, const BigInteger& b) {
+          return barrett(a * b);
+        },
+        [this](const BigInteger& a) { return barrett(a.square()); });
+  }
 
-  int tSize = target.size();
-  int log2 = 1;
-  while ((1 << log2) < tSize) log2++;
+  BigInteger power = BigInteger::windowPow(
+      redc(reduce(base) * rSquared), exp, one,
+      [this](const BigInteger& a, const BigInteger& b) {
+        return redc(a * b);
+      },
+      [this](const BigInteger& a) { return redc(a.square()); });
+  return redc(power);
+}
 
-  for (int i = 0; i < tSize; ++i) {
-    int j = reverseBits(i, log2);
-    if (i < j) {
-      comp swap = target[i];
-      target[i] = target[j];
-      target[j] = swap;
-    }
-  }
+// base^exp mod |mod| for exp >= 0 and mod != 0; build a ModularContext
+// instead when the modulus is reused.
+BigInteger powmod(const BigInteger& base, const BigInteger& exp,
+                  const BigInteger& mod) {
+  return ModularContext(mod).pow(base, exp);
+}
 
-  for (int segmentLen = 2; segmentLen <= tSize; segmentLen *= 2) {
-    double ang = PI * 2 / segmentLen * (invert ? 1 : -1);
-    comp wlen(cos(ang), sin(ang));
-    for (int st = 0; st < tSize; st += segmentLen) {
-      comp w(1);
-      for (int j = st; j < st + segmentLen / 2; ++j) {
-        comp u = target[j], v = target[j + segmentLen / 2] * w;
-        target[j] = u + v;
-        target[j + segmentLen / 2] = u - v;
-        w *= wlen;
-      }
-    }
+// floor(|x|^(1/n)) for n >= 1, negated for negative x and odd n, so that
+// iroot(-9, 3) == -2. n == 0 and an even root of a negative x have no
+// integer answer and stop the program, as division by zero does. The root of the top half of the bits, computed
+// recursively, gives an estimate above the root with about half the bits
+// correct. Newton steps from above never undershoot, and the first one
+// nearly doubles the correct bits, so the last level costs a few
+// multiplications and divisions of full length. Roots of at most 32 bits are
+// seeded from a floating-point estimate instead.
+BigInteger iroot(const BigInteger& x, limb n) {
+  if (n == 0 or (!x.sign and n % 2 == 0)) __builtin_trap();
+  if (n == 1) return x;
+  if (!x.sign and n % 2) return -iroot(x.abs(), n);
+  BigInteger absX = x.abs();
+  size_t bits = x.bitLength();
+  if (bits <= n) return BigInteger(bits ? 1 : 0);
+
+  BigInteger root;
+  size_t rootBits = (bits + n - 1) / n;
+  bool above = rootBits > 32;  // the recursive estimate always is
+  if (!above) {
+    size_t shift = bits > 64 ? bits - 64 : 0;
+    double top = static_cast<double>(x.bitsFrom(shift));
+    double estimate = std::exp2((std::log2(top) + shift) / n);
+    root = BigInteger(static_cast<long long>(estimate) + 2);
+  } else {
+    size_t k = rootBits / 2 - 1;
+    root = iroot(absX >> (n * k), n);
+    root.addSmall(1);
+    root <<= k;
   }
 
-  if (invert) {
-    for (int i = 0; i < tSize; ++i) {
-      target[i] /= tSize;
-    }
+  while (true) {
+    BigInteger power = pow(root, n - 1);
+    if (!above and (n == 2 ? root.square() : power * root) <= absX) break;
+    above = false;
+    root.mulSmall(n - 1);
+    root += absX / power;
+    root.divSmall(n);
   }
+  return root;
 }
 
-void BigInteger::multOnBigInt(const BigInteger& right) {
-  if (isZero()) return;
-
-  if (right.isZero()) {
-    digits.clear();
-    digits.push_back(0);
-    sign = 1;
+// floor(sqrt(x)) for x >= 0.
+BigInteger isqrt(const BigInteger& x) { return iroot(x, 2); }
+
+// Most non-squares are rejected by their residues modulo 64, 63, 65 and 11
+// before any root is taken.
+bool isPerfectSquare(const BigInteger& x) {
+  if (x < 0) return false;
+  static const std::vector<std::vector<bool>> squares = [] {
+    std::vector<std::vector<bool>> table;
+    for (limb m : {64, 63, 65, 11}) {
+      table.emplace_back(m, false);
+      for (limb i = 0; i < m; ++i) table.back()[i * i % m] = true;
+    }
+    return table;
+  }();
+  const limb moduli[] = {64, 63, 65, 11};
+  limb residue = x.modSmall(64 * 63 * 65 * 11);
+  for (size_t i = 0; i < 4; ++i) {
+    if (!squares[i][residue % moduli[i]]) return false;
   }
 
-  sign = (sign == right.sign);
-
-  std::vector<comp> fftLeft(digits.begin(), digits.end());
-  std::vector<comp> fftRight(right.digits.begin(), right.digits.end());
+  BigInteger root = isqrt(x);
+  return root.square() == x;
+}
 
-  int fftSize = 1;
-  while (fftSize < static_cast<int>(fftLeft.size()) or
-         fftSize < static_cast<int>(fftRight.size())) {
-    fftSize *= 2;
-  }
-  fftSize *= 2;
-  fftLeft.resize(fftSize);
-  fftRight.resize(fftSize);
+// Signed Bits-bit integer (Bits a multiple of 32) in two's complement with
+// its limbs stored inline, for values with a known bound. Arithmetic wraps
+// modulo 2^Bits like machine integers; division truncates toward zero and >>
+// rounds toward minus infinity, as for BigInteger. Everything but the
+// conversions to BigInteger and text is constexpr, so constants can be
+// computed at compile time. It is built on if constexpr and C++17 constexpr
+// rules, so it is only defined from C++17 on; BigInteger itself needs C++11.
+#if __cplusplus >= 201703L
+template <size_t Bits>
+class FixedBigInteger {
+  static_assert(Bits > 0 and Bits % 32 == 0,
+                "FixedBigInteger needs a positive multiple of 32 bits");
 
-  fft(fftLeft, false);
-  fft(fftRight, false);
-  for (int i = 0; i < fftSize; ++i) fftLeft[i] *= fftRight[i];
-  fft(fftLeft, true);
+ private:
+  static constexpr size_t limbCount = Bits / 32;
+  static constexpr int limbBits = 32;
+  typedef std::array<limb, limbCount> Limbs;
 
-  digits.resize(fftSize);
-  for (int i = 0; i < fftSize; ++i)
-    digits[i] = static_cast<long long>(fftLeft[i].real() + 0.5);
+  Limbs digits;  // two's complement, least significant limb first
 
-  long long carry = 0;
-  for (size_t i = 0; i < digits.size(); ++i) {
-    digits[i] += carry;
-    carry = digits[i] / base;
-    digits[i] %= base;
+  constexpr bool isNegative() const {
+    return digits[limbCount - 1] >> (limbBits - 1);
   }
 
-  removeLeadingZeros();
-}
+  constexpr void negate() {
+    limb carry = 1;
+    for (size_t i = 0; i < limbCount; ++i) {
+      digits[i] = ~digits[i] + carry;
+      carry &= digits[i] == 0;
+    }
+  }
 
-void BigInteger::multOnInt(long long right) {
-  if (right < 0) {
-    right *= -1;
-    sign ^= 1;
+  constexpr void mulAddSmall(limb factor, limb addend) {
+    dlimb carry = addend;
+    for (size_t i = 0; i < limbCount; ++i) {
+      carry += static_cast<dlimb>(digits[i]) * factor;
+      digits[i] = static_cast<limb>(carry);
+      carry >>= limbBits;
+    }
   }
 
-  for (size_t i = 0; i < digits.size(); ++i) digits[i] *= right;
+  // Knuth's algorithm D on the magnitudes a and b, as in
+  // BigInteger::divSchoolbook. A zero divisor stops the program, as it does
+  // for BigInteger, and is a compile error in constant evaluation.
+  static constexpr void divideMagnitudes(const Limbs& a, const Limbs& b,
+                                         Limbs& q, Limbs& r) {
+    size_t n = limbCount, m = limbCount;
+    while (n > 0 and !a[n - 1]) --n;
+    while (m > 0 and !b[m - 1]) --m;
+    if (m == 0) __builtin_trap();
+    q = Limbs{};
+    r = Limbs{};
+    if (n < m) {
+      r = a;
+      return;
+    }
 
-  for (size_t i = 0; i < digits.size(); ++i) {
-    if (digits[i] >= base) {
-      if (i == digits.size() - 1) {
-        digits.push_back(digits[i] / base);
-      } else {
-        digits[i + 1] += digits[i] / base;
+    if (m == 1) {
+      dlimb rem = 0;
+      for (size_t i = n; i-- > 0;) {
+        rem = (rem << limbBits) | a[i];
+        q[i] = static_cast<limb>(rem / b[0]);
+        rem %= b[0];
       }
-      digits[i] %= base;
+      r[0] = static_cast<limb>(rem);
+      return;
     }
-  }
-}
 
-void BigInteger::devide(const BigInteger& right,
-                        bool mode) {  // 0 is quotient, 1 is remainder
-  BigInteger cur, res;
-  res.digits.resize(digits.size());
-  BigInteger b = right;
-  b.sign = 1;
-  BigInteger precalc[base];
-  precalc[0] = 0;
-  for (int i = 1; i < base; ++i) {
-    precalc[i] = precalc[i - 1] + b;
-  }
-
-  for (int i = digits.size() - 1; i >= 0; --i) {
-    cur *= base;
-    cur.digits[0] = digits[i];
-    cur.removeLeadingZeros();
-    long long l = 0, r = base;
-    while (r - l > 1) {
-      long long m = (r + l) / 2;
-      if (precalc[m] <= cur) {
-        l = m;
-      } else {
-        r = m;
+    // A single limb always takes the branch above.
+    if constexpr (limbCount > 1) {
+      int s = __builtin_clz(b[m - 1]);
+      std::array<limb, limbCount + 1> un{};
+      Limbs vn{};
+      for (size_t i = m - 1; i > 0; --i)
+        vn[i] = (b[i] << s) | (s ? b[i - 1] >> (limbBits - s) : 0);
+      vn[0] = b[0] << s;
+      un[n] = s ? a[n - 1] >> (limbBits - s) : 0;
+      for (size_t i = n - 1; i > 0; --i)
+        un[i] = (a[i] << s) | (s ? a[i - 1] >> (limbBits - s) : 0);
+      un[0] = a[0] << s;
+
+      for (size_t j = n - m + 1; j-- > 0;) {
+        dlimb num = (static_cast<dlimb>(un[j + m]) << limbBits) | un[j + m - 1];
+        dlimb qhat = num / vn[m - 1], rhat = num % vn[m - 1];
+        while ((qhat >> limbBits) or
+               qhat * vn[m - 2] > ((rhat << limbBits) | un[j + m - 2])) {
+          --qhat;
+          rhat += vn[m - 1];
+          if (rhat >> limbBits) break;
+        }
+
+        int64_t borrow = 0, t = 0;
+        for (size_t i = 0; i < m; ++i) {
+          dlimb p = qhat * vn[i];
+          t = static_cast<int64_t>(un[i + j]) - borrow -
+              static_cast<int64_t>(p & 0xffffffffu);
+          un[i + j] = static_cast<limb>(t);
+          borrow = static_cast<int64_t>(p >> limbBits) - (t >> limbBits);
+        }
+        t = static_cast<int64_t>(un[j + m]) - borrow;
+        un[j + m] = static_cast<limb>(t);
+
+        q[j] = static_cast<limb>(qhat);
+        if (t < 0) {
+          --q[j];
+          dlimb carry = 0;
+          for (size_t i = 0; i < m; ++i) {
+            carry += static_cast<dlimb>(un[i + j]) + vn[i];
+            un[i + j] = static_cast<limb>(carry);
+            carry >>= limbBits;
+          }
+          un[j + m] += static_cast<limb>(carry);
+        }
       }
+
+      for (size_t i = 0; i < m; ++i)
+        r[i] = (un[i] >> s) | (s ? un[i + 1] << (limbBits - s) : 0);
     }
-    cur -= precalc[l];
-    res.digits[i] = l;
   }
 
-  res.removeLeadingZeros();
-  if (!res.isZero()) res.sign = (sign == right.sign);
-
-  if (!cur.isZero()) cur.sign = sign;
-
-  if (mode)
-    *this = res;
-  else
-    *this = cur;
-}
-
-std::string BigInteger::toString() const {
-  std::string result = "";
-  for (size_t i = 0; i < digits.size(); ++i) {
-    long long curDigit = digits[i];
-    long long mod = 1;
-    while (mod < base) {
-      result += (curDigit % 10 + '0');
-      curDigit /= 10;
-      mod *= 10;
+  // Keeps the quotient (mode 1) or the remainder (mode 0), like
+  // BigInteger::devide.
+  constexpr void divide(const FixedBigInteger& right, bool mode) {
+    bool negative = isNegative(), rightNegative = right.isNegative();
+    FixedBigInteger a = *this, b = right;
+    if (negative) a.negate();
+    if (rightNegative) b.negate();
+
+    FixedBigInteger q, r;
+    divideMagnitudes(a.digits, b.digits, q.digits, r.digits);
+    if (mode) {
+      *this = q;
+      if (negative != rightNegative) negate();
+    } else {
+      *this = r;
+      if (negative) negate();
     }
   }
 
-  while (result.size() > 1 and result.back() == '0') result.pop_back();
+ public:
+  constexpr FixedBigInteger() : digits{} {}
+
+  // Any integer type is an exact match, so a literal 0 is never taken for
+  // the null pointer the string constructors reject. Unsigned values are
+  // zero-extended.
+  template <typename Integer,
+            typename = std::enable_if_t<std::is_integral_v<Integer>>>
+  constexpr FixedBigInteger(Integer n) : digits{} {
+    bool negative = false;
+    if constexpr (std::is_signed_v<Integer>) negative = n < 0;
+    unsigned long long value = static_cast<unsigned long long>(n);
+    for (size_t i = 0; i < limbCount; ++i) {
+      digits[i] = static_cast<limb>(value);
+      value = negative ? (value >> limbBits) | (~0ull << limbBits)
+                       : value >> limbBits;
+    }
+  }
 
-  if (!sign) {
-    result += '-';
+  // Decimal digits with an optional leading '-'. A null pointer is not a
+  // string and does not compile.
+  explicit constexpr FixedBigInteger(std::string_view decimal) : digits{} {
+    bool negative = !decimal.empty() and decimal[0] == '-';
+    for (size_t i = negative; i < decimal.size(); ++i) {
+      if (decimal[i] < '0' or decimal[i] > '9') break;
+      mulAddSmall(10, decimal[i] - '0');
+    }
+    if (negative) negate();
+  }
+  FixedBigInteger(std::nullptr_t) = delete;
+
+  // x modulo 2^Bits.
+  explicit FixedBigInteger(const BigInteger& x) : digits{} {
+    BigIntegerView view = x.view();
+    for (size_t i = 0; i < limbCount and i < view.size(); ++i)
+      digits[i] = view.limbs()[i];
+    if (view.isNegative()) negate();
   }
 
-  for (size_t i = 0; i < result.size() / 2; ++i) {
-    char swap = result[i];
-    result[i] = result[result.size() - i - 1];
-    result[result.size() - i - 1] = swap;
+  BigInteger toBigInteger() const {
+    FixedBigInteger magnitude = abs();
+    return BigInteger(BigIntegerView(magnitude.digits.data(), limbCount,
+                                     isNegative()));
   }
 
-  return result;
-}
+  std::string toString() const { return toBigInteger().toString(); }
 
-bool BigInteger::less(const BigInteger& right) const {
-  if (sign == right.sign) {
-    if (digits.size() == right.digits.size()) {
-      for (int i = digits.size() - 1; i >= 0; --i) {
-        if (digits[i] != right.digits[i])
-          return (digits[i] < right.digits[i]) ^ (!sign);
-      }
-      return false;
-    } else {
-      return (digits.size() < right.digits.size()) ^ (!sign);
+  constexpr int compare(const FixedBigInteger& right) const {
+    bool negative = isNegative(), rightNegative = right.isNegative();
+    if (negative != rightNegative) return negative ? -1 : 1;
+    for (size_t i = limbCount; i-- > 0;) {
+      if (digits[i] != right.digits[i])
+        return digits[i] < right.digits[i] ? -1 : 1;
     }
-  } else {
-    return sign == 0;
+    return 0;
+  }
+  constexpr bool less(const FixedBigInteger& right) const {
+    return compare(right) < 0;
+  }
+  constexpr bool equal(const FixedBigInteger& right) const {
+    return compare(right) == 0;
   }
-}
 
-bool BigInteger::equal(const BigInteger& right) const {
-  if (sign != right.sign or digits.size() != right.digits.size()) return false;
-  for (size_t i = 0; i < digits.size(); ++i)
-    if (digits[i] != right.digits[i]) return false;
-  return true;
-}
+  constexpr FixedBigInteger abs() const {
+    FixedBigInteger res = *this;
+    if (isNegative()) res.negate();
+    return res;
+  }
+  constexpr FixedBigInteger square() const { return *this * *this; }
+
+  // Bit length of the magnitude, 0 for zero.
+  constexpr size_t bitLength() const {
+    FixedBigInteger magnitude = abs();
+    for (size_t i = limbCount; i-- > 0;) {
+      if (magnitude.digits[i])
+        return (i + 1) * limbBits - __builtin_clz(magnitude.digits[i]);
+    }
+    return 0;
+  }
 
-BigInteger BigInteger::abs() const {
-  BigInteger result = (*this);
-  result.sign = 1;
-  return result;
-}
+  constexpr FixedBigInteger operator-() const {
+    FixedBigInteger res = *this;
+    res.negate();
+    return res;
+  }
+  constexpr FixedBigInteger operator~() const {
+    FixedBigInteger res;
+    for (size_t i = 0; i < limbCount; ++i) res.digits[i] = ~digits[i];
+    return res;
+  }
 
-BigInteger BigInteger::operator-() {
-  BigInteger res = (*this);
-  if (!isZero()) res.sign ^= 1;
-  return res;
-}
+  constexpr FixedBigInteger& operator++() { return *this += 1; }
+  constexpr FixedBigInteger operator++(int) {
+    FixedBigInteger res = *this;
+    *this += 1;
+    return res;
+  }
+  constexpr FixedBigInteger& operator--() { return *this -= 1; }
+  constexpr FixedBigInteger operator--(int) {
+    FixedBigInteger res = *this;
+    *this -= 1;
+    return res;
+  }
 
-BigInteger& BigInteger::operator++() {
-  if (sign) {
-    addOne();
-  } else {
-    subtractOne();
+  constexpr FixedBigInteger& operator+=(const FixedBigInteger& right) {
+    dlimb carry = 0;
+    for (size_t i = 0; i < limbCount; ++i) {
+      carry += static_cast<dlimb>(digits[i]) + right.digits[i];
+      digits[i] = static_cast<limb>(carry);
+      carry >>= limbBits;
+    }
+    return *this;
   }
-  return *this;
-}
 
-BigInteger BigInteger::operator++(int) {
-  BigInteger res = *this;
-  ++(*this);
-  return res;
-}
+  constexpr FixedBigInteger& operator-=(const FixedBigInteger& right) {
+    limb borrow = 0;
+    for (size_t i = 0; i < limbCount; ++i) {
+      dlimb diff = static_cast<dlimb>(digits[i]) - right.digits[i] - borrow;
+      digits[i] = static_cast<limb>(diff);
+      borrow = static_cast<limb>(diff >> limbBits) & 1;
+    }
+    return *this;
+  }
 
-BigInteger& BigInteger::operator--() {
-  if (sign) {
-    subtractOne();
-  } else {
-    addOne();
+  // The low Bits bits of the product, which are the same for two's
+  // complement and unsigned operands.
+  constexpr FixedBigInteger& operator*=(const FixedBigInteger& right) {
+    Limbs res{};
+    for (size_t i = 0; i < limbCount; ++i) {
+      dlimb carry = 0;
+      for (size_t j = 0; i + j < limbCount; ++j) {
+        carry += static_cast<dlimb>(digits[i]) * right.digits[j] + res[i + j];
+        res[i + j] = static_cast<limb>(carry);
+        carry >>= limbBits;
+      }
+    }
+    digits = res;
+    return *this;
   }
-  return *this;
-}
 
-BigInteger BigInteger::operator--(int) {
-  BigInteger res = *this;
-  --(*this);
-  return res;
-}
+  constexpr FixedBigInteger& operator/=(const FixedBigInteger& right) {
+    divide(right, 1);
+    return *this;
+  }
+  constexpr FixedBigInteger& operator%=(const FixedBigInteger& right) {
+    divide(right, 0);
+    return *this;
+  }
 
-BigInteger& BigInteger::operator+=(const BigInteger& right) {
-  if (sign) {
-    if (right.sign)
-      addPositive(right);
-    else
-      subtractPositive(right);
-  } else {
-    if (right.sign)
-      subtractPositive(right);
-    else
-      addPositive(right);
+  constexpr FixedBigInteger& operator&=(const FixedBigInteger& right) {
+    for (size_t i = 0; i < limbCount; ++i) digits[i] &= right.digits[i];
+    return *this;
+  }
+  constexpr FixedBigInteger& operator|=(const FixedBigInteger& right) {
+    for (size_t i = 0; i < limbCount; ++i) digits[i] |= right.digits[i];
+    return *this;
+  }
+  constexpr FixedBigInteger& operator^=(const FixedBigInteger& right) {
+    for (size_t i = 0; i < limbCount; ++i) digits[i] ^= right.digits[i];
+    return *this;
   }
-  return *this;
-}
 
-BigInteger& BigInteger::operator-=(const BigInteger& right) {
-  if (sign) {
-    if (right.sign)
-      subtractPositive(right);
-    else
-      addPositive(right);
-  } else {
-    if (right.sign)
-      addPositive(right);
-    else
-      subtractPositive(right);
+  constexpr FixedBigInteger& operator<<=(size_t bits) {
+    size_t count = std::min(bits / limbBits, limbCount);
+    int shift = bits % limbBits;
+    for (size_t i = limbCount; i-- > 0;) {
+      limb high = i >= count ? digits[i - count] : 0;
+      limb low = i >= count + 1 ? digits[i - count - 1] : 0;
+      digits[i] = shift ? (high << shift) | (low >> (limbBits - shift)) : high;
+    }
+    return *this;
   }
-  return *this;
-}
 
-BigInteger& BigInteger::operator*=(const BigInteger& right) {
-  multOnBigInt(right);
-  return *this;
-}
+  constexpr FixedBigInteger& operator>>=(size_t bits) {
+    limb fill = isNegative() ? ~limb(0) : 0;
+    size_t count = std::min(bits / limbBits, limbCount);
+    int shift = bits % limbBits;
+    for (size_t i = 0; i < limbCount; ++i) {
+      limb low = i + count < limbCount ? digits[i + count] : fill;
+      limb high = i + count + 1 < limbCount ? digits[i + count + 1] : fill;
+      digits[i] = shift ? (low >> shift) | (high << (limbBits - shift)) : low;
+    }
+    return *this;
+  }
 
-BigInteger& BigInteger::operator*=(long long right) {
-  multOnInt(right);
-  return *this;
-}
+  explicit constexpr operator bool() const {
+    for (limb d : digits) {
+      if (d) return true;
+    }
+    return false;
+  }
 
-BigInteger& BigInteger::operator/=(const BigInteger& right) {
-  devide(right, 1);
-  return *this;
-}
+  friend constexpr FixedBigInteger operator+(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left += right;
+  }
+  friend constexpr FixedBigInteger operator-(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left -= right;
+  }
+  friend constexpr FixedBigInteger operator*(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left *= right;
+  }
+  friend constexpr FixedBigInteger operator/(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left /= right;
+  }
+  friend constexpr FixedBigInteger operator%(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left %= right;
+  }
+  friend constexpr FixedBigInteger operator&(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left &= right;
+  }
+  friend constexpr FixedBigInteger operator|(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left |= right;
+  }
+  friend constexpr FixedBigInteger operator^(FixedBigInteger left,
+                                             const FixedBigInteger& right) {
+    return left ^= right;
+  }
+  friend constexpr FixedBigInteger operator<<(FixedBigInteger left,
+                                              size_t bits) {
+    return left <<= bits;
+  }
+  friend constexpr FixedBigInteger operator>>(FixedBigInteger left,
+                                              size_t bits) {
+    return left >>= bits;
+  }
 
-BigInteger& BigInteger::operator%=(const BigInteger& right) {
-  devide(right, 0);
-  return *this;
-}
+  friend constexpr bool operator==(const FixedBigInteger& left,
+                                   const FixedBigInteger& right) {
+    return left.equal(right);
+  }
+  friend constexpr bool operator!=(const FixedBigInteger& left,
+                                   const FixedBigInteger& right) {
+    return !left.equal(right);
+  }
+  friend constexpr bool operator<(const FixedBigInteger& left,
+                                  const FixedBigInteger& right) {
+    return left.compare(right) < 0;
+  }
+  friend constexpr bool operator>(const FixedBigInteger& left,
+                                  const FixedBigInteger& right) {
+    return left.compare(right) > 0;
+  }
+  friend constexpr bool operator<=(const FixedBigInteger& left,
+                                   const FixedBigInteger& right) {
+    return left.compare(right) <= 0;
+  }
+  friend constexpr bool operator>=(const FixedBigInteger& left,
+                                   const FixedBigInteger& right) {
+    return left.compare(right) >= 0;
+  }
+#if __cplusplus >= 202002L
+  friend constexpr std::strong_ordering operator<=>(
+      const FixedBigInteger& left, const FixedBigInteger& right) {
+    return left.compare(right) <=> 0;
+  }
+#endif
 
-BigInteger::operator bool() const { return !isZero(); }
+  friend std::ostream& operator<<(std::ostream& os,
+                                  const FixedBigInteger& value) {
+    return os << value.toBigInteger();
+  }
+};
+#endif
 
 class Rational {
  private:
-  BigInteger p, q;
+  mutable BigInteger p, q;
+  // False while p and q may still share a factor (lazy mode only).
+  mutable bool reduced;
 
   void normalizeSign();
 
-  void normalizeByGCD();
+  void normalizeByGCD() const;
+
+  void addFraction(const Rational& right, bool subtract);
+  void multiplyFraction(const BigInteger& rightP, const BigInteger& rightQ);
+
+  static uint64_t leadingBits(const BigInteger& x);
+  double toDoubleExact(long diff) const;
 
  public:
-  Rational() : p(0ll), q(1ll){};
-  Rational(long long a) : p(a), q(1ll){};
-  Rational(const BigInteger& a) : p(a), q(1ll){};
+  Rational() : p(0ll), q(1ll), reduced(true){};
+  Rational(long long a) : p(a), q(1ll), reduced(true){};
+  Rational(const BigInteger& a) : p(a), q(1ll), reduced(true){};
 
   std::string toString() const;
 
   bool less(const Rational& right) const;
   bool equal(const Rational& right) const;
+  // -1, 0 or 1 as this is less than, equal to or greater than right.
+  int compare(const Rational& right) const;
 
   std::string asDecimal(size_t precisions) const;
+  // Nearest double, ties to even, read from the leading limbs of p and q.
+  double toDouble() const;
 
   Rational& operator+=(const Rational& right);
   Rational& operator-=(const Rational& right);
@@ -613,12 +3679,11 @@ bool operator==(const Rational& left, const Rational& right) {
 }
 
 bool operator<(const Rational& left, const Rational& right) {
-  return left.less(right);
+  return left.compare(right) < 0;
 }
 
 bool operator>(const Rational& left, const Rational& right) {
-  return right.less(left);
-  ;
+  return left.compare(right) > 0;
 }
 
 bool operator!=(const Rational& left, const Rational& right) {
@@ -626,58 +3691,212 @@ bool operator!=(const Rational& left, const Rational& right) {
 }
 
 bool operator<=(const Rational& left, const Rational& right) {
-  return left.less(right) or left.equal(right);
+  return left.compare(right) <= 0;
 }
 
 bool operator>=(const Rational& left, const Rational& right) {
-  return right.less(left) or left.equal(right);
+  return left.compare(right) >= 0;
 }
 
-Rational& Rational::operator+=(const Rational& right) {
-  p = p * right.q + q * right.p;
-  q *= right.q;
-  normalizeSign();
-  normalizeByGCD();
+#if __cplusplus >= 202002L
+std::strong_ordering operator<=>(const Rational& left, const Rational& right) {
+  return left.compare(right) <=> 0;
+}
+#endif
 
+Rational& Rational::operator+=(const Rational& right) {
+  addFraction(right, false);
   return (*this);
 }
 
 Rational& Rational::operator-=(const Rational& right) {
-  p = p * right.q - q * right.p;
-  q *= right.q;
-  normalizeSign();
-  normalizeByGCD();
-
+  addFraction(right, true);
   return (*this);
 }
 
 Rational& Rational::operator*=(const Rational& right) {
-  p *= right.p;
-  q *= right.q;
+  multiplyFraction(right.p, right.q);
   normalizeSign();
-  normalizeByGCD();
 
   return (*this);
 }
 
 Rational& Rational::operator/=(const Rational& right) {
-  p *= right.q;
-  q *= right.p;
+  multiplyFraction(right.q, right.p);
   normalizeSign();
-  normalizeByGCD();
 
   return (*this);
 }
 
+// Henrici's addition: with g = gcd(q1, q2) the sum is
+// (p1 * (q2 / g) + p2 * (q1 / g)) / (q1 * q2 / g), and only a divisor of g can
+// still cancel, so the result is reduced by gcd(numerator, g) instead of a
+// gcd against the full product.
+void Rational::addFraction(const Rational& right, bool subtract) {
+  if (BIGINT_RATIONAL_LAZY) {
+    if (q == right.q) {
+      if (subtract) {
+        p -= right.p;
+      } else {
+        p += right.p;
+      }
+    } else {
+      p *= right.q;
+      if (subtract) {
+        subMul(p, q, right.p);
+      } else {
+        addMul(p, q, right.p);
+      }
+      q *= right.q;
+    }
+    reduced = false;
+    return;
+  }
+
+  BigInteger g = gcd(q, right.q);
+  BigInteger rightScale = g == 1 ? right.q : right.q / g;
+  BigInteger leftScale = g == 1 ? q : q / g;
+  // For x += x the scale is 1, so p still equals right.p below.
+  p *= rightScale;
+  if (subtract) {
+    subMul(p, leftScale, right.p);
+  } else {
+    addMul(p, leftScale, right.p);
+  }
+
+  if (p == 0) {
+    q = 1;
+    return;
+  }
+
+  if (g != 1) {
+    BigInteger common = gcd(p, g);
+    if (common != 1) {
+      p /= common;
+      q /= common;
+    }
+  }
+  q *= rightScale;
+}
+
+// Multiplies by rightP / rightQ after cancelling gcd(p, rightQ) and
+// gcd(rightP, q), so the product is reduced without a gcd on full-size
+// operands.
+void Rational::multiplyFraction(const BigInteger& rightP,
+                                const BigInteger& rightQ) {
+  if (BIGINT_RATIONAL_LAZY) {
+    BigInteger scale = rightQ;
+    p *= rightP;
+    q *= scale;
+    reduced = false;
+    return;
+  }
+
+  BigInteger numerator = rightP, denominator = rightQ;
+  if (p == 0 or numerator == 0) {
+    p = 0;
+    q = denominator == 0 ? 0 : 1;
+    return;
+  }
+
+  BigInteger first = gcd(p, denominator), second = gcd(numerator, q);
+  if (first != 1) {
+    p /= first;
+    denominator /= first;
+  }
+  if (second != 1) {
+    numerator /= second;
+    q /= second;
+  }
+  p *= numerator;
+  q *= denominator;
+}
+
 Rational Rational::operator-() {
   Rational res = (*this);
   res.p *= -1;
   return res;
 }
 
-Rational::operator double() { return atof((this->asDecimal(24)).c_str()); };
+Rational::operator double() { return toDouble(); };
+
+// The top 64 bits of a nonzero |x|, shifted so that bit 63 is set.
+uint64_t Rational::leadingBits(const BigInteger& x) {
+  BigIntegerView v = x.view();
+  const limb* d = v.limbs();
+  size_t n = v.size();
+  unsigned __int128 window = static_cast<unsigned __int128>(d[n - 1]) << 64;
+  if (n > 1) window |= static_cast<unsigned __int128>(d[n - 2]) << 32;
+  if (n > 2) window |= d[n - 3];
+  return static_cast<uint64_t>(window << (__builtin_clz(d[n - 1]) + 32) >> 64);
+}
+
+// The quotient of the leading 64 bits of p and q is within 5 units of
+// |p / q| * 2^(64 - diff), where diff is the difference of the bit lengths.
+// Unless its dropped bits lie that close to a rounding boundary it rounds the
+// same way as the exact quotient; otherwise toDoubleExact divides in full.
+double Rational::toDouble() const {
+  if (!p) return 0.0;
+  bool negative = p < 0;
+  size_t pBits = p.bitLength(), qBits = q.bitLength();
+  uint64_t a = leadingBits(p), b = leadingBits(q);
+
+  if (pBits <= 53 and qBits <= 53) {
+    double value = double(a >> (64 - pBits)) / double(b >> (64 - qBits));
+    return negative ? -value : value;
+  }
+
+  long diff = long(pBits) - long(qBits);
+  if (diff > 1025) return negative ? -HUGE_VAL : HUGE_VAL;
+  if (diff < -1076) return negative ? -0.0 : 0.0;
+
+  unsigned __int128 estimate = (static_cast<unsigned __int128>(a) << 64) / b;
+  long scale = 64 - diff;
+  long bits = estimate >> 64 ? 65 : 64;
+  long drop = std::max(bits - 53, scale - 1074);
+  if (drop < 64) {
+    const uint64_t margin = 16;
+    uint64_t mask = (uint64_t(1) << drop) - 1, half = uint64_t(1) << (drop - 1);
+    uint64_t low = static_cast<uint64_t>(estimate) & mask;
+    if (low > margin and mask - low > margin and
+        (low > half + margin or low + margin < half)) {
+      uint64_t mantissa = static_cast<uint64_t>(estimate >> drop) + (low > half);
+      double value = std::ldexp(double(mantissa), int(drop - scale));
+      return negative ? -value : value;
+    }
+  }
+  return toDoubleExact(diff);
+}
+
+// Rounds floor(|p| * 2^scale / q), a 55 or 56 bit integer, with the remainder
+// as a sticky bit.
+double Rational::toDoubleExact(long diff) const {
+  bool negative = p < 0;
+  long scale = 55 - diff;
+  BigInteger numerator = p.abs(), denominator = q;
+  if (scale > 0) {
+    numerator <<= scale;
+  } else {
+    denominator <<= -scale;
+  }
+  std::pair<BigInteger, BigInteger> division = divmod(numerator, denominator);
+  bool sticky = bool(division.second);
+  BigIntegerView v = division.first.view();
+  uint64_t quotient = v.limbs()[0] | (uint64_t(v.limbs()[1]) << 32);
+
+  long bits = division.first.bitLength();
+  long drop = std::max(bits - 53, scale - 1074);
+  if (drop > bits) return negative ? -0.0 : 0.0;
+
+  uint64_t mask = (uint64_t(1) << drop) - 1, half = uint64_t(1) << (drop - 1);
+  uint64_t low = quotient & mask, mantissa = quotient >> drop;
+  if (low > half or (low == half and (sticky or (mantissa & 1)))) ++mantissa;
+  double value = std::ldexp(double(mantissa), int(drop - scale));
+  return negative ? -value : value;
+}
 
 std::string Rational::toString() const {
+  normalizeByGCD();
   std::string res = p.toString();
   if (q != 1) res += "/" + q.toString();
   return res;
@@ -690,66 +3909,76 @@ void Rational::normalizeSign() {
   }
 }
 
-void Rational::normalizeByGCD() {
-  BigInteger a = p.abs(), b = q;
+void Rational::normalizeByGCD() const {
+  if (reduced) return;
+  reduced = true;
 
-  while (a != 0 and b != 0) {
-    if (a > b) {
-      a %= b;
-    } else {
-      b %= a;
-    }
-  }
+  BigInteger d = gcd(p, q);
+  if (d == 1) return;
 
-  BigInteger d = (a + b);
   p /= d;
   q /= d;
 }
 
 bool Rational::less(const Rational& right) const {
-  return p * right.q < right.p * q;
-}
-
-bool Rational::equal(const Rational& right) const {
-  return p * right.q == right.p * q;
+  return compare(right) < 0;
 }
 
-std::string Rational::asDecimal(size_t precision = 0) const {
-  BigInteger shift = 1;
-  for (size_t i = 0; i < precision; ++i) shift *= 10;
-
-  BigInteger numberAsDecimal = (p.abs() * shift) / q;
-  if ((p.abs() * shift % q) * 2 >= q) numberAsDecimal++;
-
-  std::string digits = numberAsDecimal.toString();
-  std::string result = "";
-  if (precision == 0) {
-    result = digits;
+// p / q against r / s is p * s against r * q. Past the signs, the bit lengths
+// of the cross products and then the products of their leading 64 bits, which
+// are within 2^-62 of the true ratio, settle almost every pair; only near-ties
+// multiply out in full.
+int Rational::compare(const Rational& right) const {
+  int sign = p.compare(0), rightSign = right.p.compare(0);
+  if (sign != rightSign) return sign < rightSign ? -1 : 1;
+  if (sign == 0) return 0;
+  if (q == right.q) return p.compare(right.p);
+
+  size_t bits = p.bitLength() + right.q.bitLength();
+  size_t rightBits = right.p.bitLength() + q.bitLength();
+  int magnitude = 0;
+  if (bits + 2 <= rightBits) {
+    magnitude = -1;
+  } else if (rightBits + 2 <= bits) {
+    magnitude = 1;
   } else {
-    int idx = digits.size() - 1;
-    while (precision--) {
-      if (idx >= 0) {
-        result += digits[idx];
-      } else {
-        result += '0';
-      }
-      idx--;
+    unsigned __int128 x = static_cast<unsigned __int128>(leadingBits(p)) *
+                          leadingBits(right.q);
+    unsigned __int128 y = static_cast<unsigned __int128>(leadingBits(right.p)) *
+                          leadingBits(q);
+    if (bits > rightBits) y >>= 1;
+    if (rightBits > bits) x >>= 1;
+    if (x < y - (y >> 60)) {
+      magnitude = -1;
+    } else if (y < x - (x >> 60)) {
+      magnitude = 1;
+    } else {
+      return (p * right.q).compare(right.p * q);
     }
+  }
+  return sign > 0 ? magnitude : -magnitude;
+}
 
-    result += '.';
-
-    while (idx >= 0) {
-      result += digits[idx];
-      idx--;
-    }
+// Reduced fractions with positive denominators are equal only if their parts
+// are, so no cross products are needed.
+bool Rational::equal(const Rational& right) const {
+  normalizeByGCD();
+  right.normalizeByGCD();
 
-    if (result.back() == '.') result += '0';
+  return p == right.p and q == right.q;
+}
 
-    for (size_t i = 0; i < result.size() / 2; ++i) {
-      char swap = result[i];
-      result[i] = result[result.size() - 1 - i];
-      result[result.size() - 1 - i] = swap;
-    }
+std::string Rational::asDecimal(size_t precision = 0) const {
+  std::pair<BigInteger, BigInteger> division =
+      divmod(p.abs() * pow(BigInteger(10), precision), q);
+  BigInteger numberAsDecimal = std::move(division.first);
+  if ((division.second << 1) >= q) numberAsDecimal++;
+
+  std::string result = numberAsDecimal.toString();
+  if (precision) {
+    if (result.size() <= precision)
+      result.insert(0, precision + 1 - result.size(), '0');
+    result.insert(result.size() - precision, 1, '.');
   }
 
   return (p < 0 ? "-" + result : result);